@@ -2,23 +2,93 @@
 // maxprotein.hh
 //
 // Compute the set of foods that maximizes protein, within a calorie budget,
-// with the greedy method or exhaustive search.
+// with the greedy method, exhaustive search, dynamic programming, or
+// branch and bound.
 //
 ///////////////////////////////////////////////////////////////////////////////
 
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cctype>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && \
+	(defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+// Build the AVX2 and AVX-512 kernels, selected at run time.
+#define MAXPROTEIN_X86_SIMD
+#endif
+
+#include "timer.hh"
+
+// Optional nutrients a Food can carry besides energy and protein.
+enum class Nutrient {
+	FAT,
+	CARBOHYDRATE,
+	FIBER,
+	SUGAR,
+	SODIUM,
+	SATURATED_FAT,
+	CHOLESTEROL
+};
+
+// Return the 0-based field of a nutrient in a USDA ABBREV line. FAT,
+// CARBOHYDRATE, FIBER, SUGAR and SATURATED_FAT are in grams; SODIUM
+// and CHOLESTEROL in milligrams.
+int usda_abbrev_field(Nutrient nutrient) {
+	switch (nutrient) {
+	case Nutrient::FAT: return 5;
+	case Nutrient::CARBOHYDRATE: return 7;
+	case Nutrient::FIBER: return 8;
+	case Nutrient::SUGAR: return 9;
+	case Nutrient::SODIUM: return 15;
+	case Nutrient::SATURATED_FAT: return 44;
+	case Nutrient::CHOLESTEROL: return 47;
+	}
+	assert(false);
+	return -1;
+}
+
+// Nutrient amounts of one sample, each rounded to an integer.
+typedef std::vector<std::pair<Nutrient, int>> NutrientList;
+
+// A max_servings value meaning as many servings as fit the budget.
+const int UNLIMITED_SERVINGS = INT_MAX;
+
 // One food item in the USDA database.
 class Food {
 private:
@@ -40,23 +110,39 @@ private:
 	// Number of grams of protein in one sample; most be non-negative.
 	int _protein_g;
 
+	// Any other nutrients that were loaded, each at most once and
+	// non-negative. Usually empty.
+	NutrientList _nutrients;
+
+	// Most samples of this food a meal may contain, for
+	// bounded_max_protein; must be non-negative. The other solvers
+	// always treat a food as one take-it-or-leave-it sample.
+	int _max_servings;
+
 public:
 	Food(const std::string& description,
 		const std::string& amount,
 		int amount_g,
 		int kcal,
-		int protein_g)
+		int protein_g,
+		const NutrientList& nutrients = NutrientList(),
+		int max_servings = 1)
 		: _description(description),
 		_amount(amount),
 		_amount_g(amount_g),
 		_kcal(kcal),
-		_protein_g(protein_g) {
+		_protein_g(protein_g),
+		_nutrients(nutrients),
+		_max_servings(max_servings) {
 
 		assert(!description.empty());
 		assert(!amount.empty());
 		assert(amount_g >= 0);
 		assert(kcal >= 0);
 		assert(protein_g >= 0);
+		for (const auto& entry : nutrients)
+			assert(entry.second >= 0);
+		assert(max_servings >= 0);
 	}
 
 	const std::string& description() const { return _description; }
@@ -64,16 +150,193 @@ public:
 	int amount_g() const { return _amount_g; }
 	int kcal() const { return _kcal; }
 	int protein_g() const { return _protein_g; }
+	const NutrientList& nutrients() const { return _nutrients; }
+	int max_servings() const { return _max_servings; }
+
+	// Whether the amount of nutrient is known.
+	bool has_nutrient(Nutrient nutrient) const {
+		for (const auto& entry : _nutrients) {
+			if (entry.first == nutrient)
+				return true;
+		}
+		return false;
+	}
+
+	// Amount of nutrient in one sample, which must be known.
+	int nutrient(Nutrient nutrient) const {
+		for (const auto& entry : _nutrients) {
+			if (entry.first == nutrient)
+				return entry.second;
+		}
+		assert(false);
+		return 0;
+	}
 
 };
 
 // Alias for a vector of shared pointers to Food objects.
 typedef std::vector<std::shared_ptr<Food>> FoodVector;
 
+// Alias for a vector of indices into a FoodVector.
+typedef std::vector<int> IndexVector;
+
+// Food database in struct-of-arrays form. The numbers every solver
+// needs are kept in contiguous int32_t columns, and the description
+// and amount strings live together in one separate string pool, so
+// scanning kcal and protein touches only a few cache lines and never
+// follows a pointer or copies a reference count. The solvers have
+// overloads that take a FoodTable and return the indices of the
+// chosen foods.
+class FoodTable {
+private:
+	// One entry per food; see Food for the meaning of each column.
+	std::vector<int32_t> _amount_g, _kcal, _protein_g;
+
+	// All the description and amount strings, back to back.
+	std::string _strings;
+
+	// Food i's description is _strings[_offsets[2i], _offsets[2i+1]),
+	// and its amount is _strings[_offsets[2i+1], _offsets[2i+2]).
+	std::vector<uint32_t> _offsets;
+
+public:
+	FoodTable() : _offsets(1, 0) { }
+
+	explicit FoodTable(const FoodVector& foods) : _offsets(1, 0) {
+		reserve(foods.size());
+		for (auto& food : foods) {
+			push_back(food->description(),
+				food->amount(),
+				food->amount_g(),
+				food->kcal(),
+				food->protein_g());
+		}
+	}
+
+	// Return a table of only the numeric columns of foods, with every
+	// description and amount empty, so nothing but three ints per food
+	// is copied. The FoodVector overloads of the solvers use this,
+	// since they map the answer back to foods and never read the
+	// strings. to_food_vector must not be called on such a table.
+	static FoodTable numbers(const FoodVector& foods) {
+		FoodTable result;
+		result.reserve(foods.size());
+		for (auto& food : foods)
+			result.push_back(food->amount_g(), food->kcal(), food->protein_g());
+		return result;
+	}
+
+	// Copy a table out of raw columns laid out like this class's
+	// members; size foods, with 2*size+1 string offsets into strings.
+	FoodTable(size_t size,
+		const int32_t* amount_g,
+		const int32_t* kcal,
+		const int32_t* protein_g,
+		const uint32_t* offsets,
+		const char* strings)
+		: _amount_g(amount_g, amount_g + size),
+		_kcal(kcal, kcal + size),
+		_protein_g(protein_g, protein_g + size),
+		_strings(strings, offsets[2 * size]),
+		_offsets(offsets, offsets + 2 * size + 1) { }
+
+	void reserve(size_t foods) {
+		_amount_g.reserve(foods);
+		_kcal.reserve(foods);
+		_protein_g.reserve(foods);
+		_offsets.reserve(2 * foods + 1);
+	}
+
+	// Append one food, with the same requirements as Food's constructor.
+	void push_back(const std::string& description,
+		const std::string& amount,
+		int amount_g,
+		int kcal,
+		int protein_g) {
+		assert(!description.empty());
+		assert(!amount.empty());
+		assert(amount_g >= 0);
+		assert(kcal >= 0);
+		assert(protein_g >= 0);
+
+		_amount_g.push_back(amount_g);
+		_kcal.push_back(kcal);
+		_protein_g.push_back(protein_g);
+		_strings += description;
+		_offsets.push_back(_strings.size());
+		_strings += amount;
+		_offsets.push_back(_strings.size());
+	}
+
+	// Append one food with an empty description and amount; see
+	// numbers.
+	void push_back(int amount_g, int kcal, int protein_g) {
+		assert(amount_g >= 0);
+		assert(kcal >= 0);
+		assert(protein_g >= 0);
+
+		_amount_g.push_back(amount_g);
+		_kcal.push_back(kcal);
+		_protein_g.push_back(protein_g);
+		_offsets.push_back(_strings.size());
+		_offsets.push_back(_strings.size());
+	}
+
+	size_t size() const { return _kcal.size(); }
+	bool empty() const { return _kcal.empty(); }
+
+	int amount_g(size_t i) const { return _amount_g[i]; }
+	int kcal(size_t i) const { return _kcal[i]; }
+	int protein_g(size_t i) const { return _protein_g[i]; }
+
+	std::string description(size_t i) const {
+		return _strings.substr(_offsets[2 * i], _offsets[2 * i + 1] - _offsets[2 * i]);
+	}
+	std::string amount(size_t i) const {
+		return _strings.substr(_offsets[2 * i + 1], _offsets[2 * i + 2] - _offsets[2 * i + 1]);
+	}
+
+	// Raw columns, for hot loops and serialization.
+	const int32_t* amount_g_data() const { return _amount_g.data(); }
+	const int32_t* kcal_data() const { return _kcal.data(); }
+	const int32_t* protein_g_data() const { return _protein_g.data(); }
+	const uint32_t* offsets_data() const { return _offsets.data(); }
+	const std::string& strings() const { return _strings; }
+
+	// Create a new Food object for every food in the table.
+	std::unique_ptr<FoodVector> to_food_vector() const {
+		std::unique_ptr<FoodVector> result(new FoodVector);
+		result->reserve(size());
+		for (size_t i = 0; i < size(); i++) {
+			result->push_back(std::shared_ptr<Food>(new Food(description(i),
+				amount(i),
+				amount_g(i),
+				kcal(i),
+				protein_g(i))));
+		}
+		return result;
+	}
+};
+
+// Return a new FoodVector holding foods[i] for each i in indices, in
+// the same order as indices. This turns the result of a FoodTable
+// solver back into the shared Food objects the table was built from.
+std::unique_ptr<FoodVector> select_foods(const FoodVector& foods,
+	const IndexVector& indices) {
+	std::unique_ptr<FoodVector> result(new FoodVector);
+	result->reserve(indices.size());
+	for (int i : indices)
+		result->push_back(foods[i]);
+	return result;
+}
+
 // Load all the valid foods from a USDA database in their ABBREV
-// format. Foods that are missing fields such as the amount string are
-// skipped. Returns nullptr on I/O error.
-std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path) {
+// format, also keeping the amounts of the nutrients in keep. Foods that
+// are missing fields such as the amount string are skipped; a nutrient
+// whose field is empty is left out of that food's nutrients(). Returns
+// nullptr on I/O error.
+std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path,
+	const std::vector<Nutrient>& keep) {
 
 	std::unique_ptr<FoodVector> failure(nullptr);
 
@@ -135,11 +398,18 @@ std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path) {
 			parse_mil(amount_g, amount_g_field) &&
 			parse_mil(kcal, kcal_field) &&
 			parse_mil(protein_g, protein_g_field)) {
+			NutrientList nutrients;
+			for (Nutrient nutrient : keep) {
+				int value;
+				if (parse_mil(value, fields[usda_abbrev_field(nutrient)]) && value >= 0)
+					nutrients.push_back(std::make_pair(nutrient, value));
+			}
 			result->push_back(std::shared_ptr<Food>(new Food(description,
 				amount,
 				amount_g,
 				kcal,
-				protein_g)));
+				protein_g,
+				nutrients)));
 		}
 	}
 
@@ -148,6 +418,596 @@ std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path) {
 	return result;
 }
 
+// Load all the valid foods from a USDA database in their ABBREV
+// format. Foods that are missing fields such as the amount string are
+// skipped. Returns nullptr on I/O error.
+std::unique_ptr<FoodVector> load_usda_abbrev(const std::string& path) {
+	return load_usda_abbrev(path, std::vector<Nutrient>());
+}
+
+// Read the entire file at path into contents with a single bulk read.
+// Returns false on I/O error.
+bool read_file(const std::string& path, std::string& contents) {
+	std::ifstream f(path, std::ios::in | std::ios::binary);
+	if (!f) {
+		return false;
+	}
+	f.seekg(0, std::ios::end);
+	const std::streamoff size = f.tellg();
+	if (size < 0) {
+		return false;
+	}
+	f.seekg(0, std::ios::beg);
+	contents.resize(size_t(size));
+	if (size > 0 && !f.read(&contents[0], size)) {
+		return false;
+	}
+	return true;
+}
+
+// Parse the number at the start of the text [begin, end) and round it
+// to the nearest integer, like the parse_mil step of load_usda_abbrev:
+// leading whitespace is skipped, anything after the number is ignored,
+// and halves round away from zero. Plain decimals are parsed digit by
+// digit without allocating; numbers with an exponent or too many
+// digits are handed to std::strtod. Returns false if there is no
+// number.
+bool parse_rounded(const char* begin, const char* end, int& output) {
+	while (begin != end && std::isspace(static_cast<unsigned char>(*begin)))
+		begin++;
+
+	const char* p = begin;
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	long whole = 0;
+	int digits = 0;
+	for (; p != end && *p >= '0' && *p <= '9' && digits < 9; p++, digits++)
+		whole = whole * 10 + (*p - '0');
+	bool round_up = false;
+	if (p != end && *p == '.') {
+		p++;
+		if (p != end && *p >= '0' && *p <= '9') {
+			round_up = (*p >= '5');
+			digits++;
+		}
+		while (p != end && *p >= '0' && *p <= '9')
+			p++;
+	}
+
+	//An exponent, or too many digits for whole, needs the slow path
+	const bool plain = (p == end) ||
+		((*p < '0' || *p > '9') && *p != 'e' && *p != 'E');
+	if (plain) {
+		if (digits == 0) {
+			return false;
+		}
+		const long rounded = whole + (round_up ? 1 : 0);
+		output = int(negative ? -rounded : rounded);
+		return true;
+	}
+
+	//Rare case: copy the field so strtod sees a terminated string
+	std::string copy(begin, end);
+	char* parsed_end = nullptr;
+	const double floating = std::strtod(copy.c_str(), &parsed_end);
+	if (parsed_end == copy.c_str()) {
+		return false;
+	}
+	output = lround(floating);
+	return true;
+}
+
+// The five fields of one line of an ABBREV file that the loaders use.
+// description and amount point into the line itself, with the
+// surrounding tildes removed.
+struct UsdaAbbrevRecord {
+	const char* description;
+	size_t description_size;
+	const char* amount;
+	size_t amount_size;
+	int amount_g;
+	int kcal;
+	int protein_g;
+};
+
+// Outcome of parse_usda_abbrev_line.
+enum class UsdaAbbrevLine {
+	// The line describes a valid food.
+	VALID,
+
+	// The line is missing a field, so load_usda_abbrev skips it.
+	INCOMPLETE,
+
+	// The line has more fields than the ABBREV format allows, so the
+	// whole file is invalid.
+	MALFORMED
+};
+
+// Parse one line [begin, end) of an ABBREV file, without its line
+// terminator, into record, accepting exactly the lines that
+// load_usda_abbrev accepts. Fields are located with memchr, and only
+// the five that are used (1, 3, 4, 48 and 49) are looked at.
+UsdaAbbrevLine parse_usda_abbrev_line(const char* begin,
+	const char* end,
+	UsdaAbbrevRecord& record) {
+	//Start and end of fields 0 through 49
+	const char* field_begin[50];
+	const char* field_end[50];
+	int fields = 0;
+	const char* p = begin;
+	while (p != end) {
+		const char* caret = static_cast<const char*>(
+			std::memchr(p, '^', end - p));
+		const char* stop = caret ? caret : end;
+		if (fields < 50) {
+			field_begin[fields] = p;
+			field_end[fields] = stop;
+		}
+		fields++;
+		if (!caret) {
+			break;
+		}
+		p = caret + 1;
+	}
+	if (fields > 53) {
+		return UsdaAbbrevLine::MALFORMED;
+	}
+	if (fields < 50) {
+		return UsdaAbbrevLine::INCOMPLETE;
+	}
+
+	auto remove_tildes = [](const char*& output,
+		size_t& size,
+		const char* field,
+		const char* field_stop) {
+		if ((field_stop - field < 3) ||
+			(*field != '~') ||
+			(*(field_stop - 1) != '~')) {
+			return false;
+		}
+		else {
+			output = field + 1;
+			size = field_stop - field - 2;
+			return true;
+		}
+	};
+
+	if (remove_tildes(record.description, record.description_size,
+		field_begin[1], field_end[1]) &&
+		remove_tildes(record.amount, record.amount_size,
+			field_begin[49], field_end[49]) &&
+		parse_rounded(field_begin[48], field_end[48], record.amount_g) &&
+		parse_rounded(field_begin[3], field_end[3], record.kcal) &&
+		parse_rounded(field_begin[4], field_end[4], record.protein_g)) {
+		return UsdaAbbrevLine::VALID;
+	}
+	return UsdaAbbrevLine::INCOMPLETE;
+}
+
+// Call visit(record) for each valid food in the ABBREV-format text
+// [begin, end), in order. Returns false if the text is malformed.
+template <typename Visitor>
+bool scan_usda_abbrev(const char* begin, const char* end, Visitor visit) {
+	UsdaAbbrevRecord record;
+	while (begin != end) {
+		const char* newline = static_cast<const char*>(
+			std::memchr(begin, '\n', end - begin));
+		const char* line_end = newline ? newline : end;
+		switch (parse_usda_abbrev_line(begin, line_end, record)) {
+		case UsdaAbbrevLine::VALID:
+			visit(record);
+			break;
+		case UsdaAbbrevLine::INCOMPLETE:
+			break;
+		case UsdaAbbrevLine::MALFORMED:
+			return false;
+		}
+		begin = newline ? newline + 1 : end;
+	}
+	return true;
+}
+
+// Load the same foods as load_usda_abbrev, much faster. The file is
+// read with one bulk read, and each line is scanned in place by
+// parse_usda_abbrev_line, so the only allocations are the Food objects
+// themselves. Returns nullptr on I/O error or a malformed file.
+std::unique_ptr<FoodVector> load_usda_abbrev_fast(const std::string& path) {
+	std::string contents;
+	if (!read_file(path, contents)) {
+		return nullptr;
+	}
+
+	std::unique_ptr<FoodVector> result(new FoodVector);
+	const char* begin = contents.data();
+	if (!scan_usda_abbrev(begin, begin + contents.size(),
+		[&](const UsdaAbbrevRecord& record) {
+		result->push_back(std::shared_ptr<Food>(new Food(
+			std::string(record.description, record.description_size),
+			std::string(record.amount, record.amount_size),
+			record.amount_g,
+			record.kcal,
+			record.protein_g)));
+	})) {
+		return nullptr;
+	}
+	return result;
+}
+
+// Load the same foods as load_usda_abbrev directly into a FoodTable,
+// without creating any per-food objects. Returns nullptr on I/O error
+// or a malformed file.
+std::unique_ptr<FoodTable> load_usda_abbrev_table(const std::string& path) {
+	std::string contents;
+	if (!read_file(path, contents)) {
+		return nullptr;
+	}
+
+	std::unique_ptr<FoodTable> result(new FoodTable);
+	const char* begin = contents.data();
+	if (!scan_usda_abbrev(begin, begin + contents.size(),
+		[&](const UsdaAbbrevRecord& record) {
+		result->push_back(std::string(record.description, record.description_size),
+			std::string(record.amount, record.amount_size),
+			record.amount_g,
+			record.kcal,
+			record.protein_g);
+	})) {
+		return nullptr;
+	}
+	return result;
+}
+
+// Parse the ABBREV file at path one record at a time, calling
+// visit(record) for each valid food, in order, until visit returns
+// false. The file is read in fixed-size chunks, so when the visitor
+// stops early, the rest of the file is never read or parsed, and no
+// intermediate FoodVector is built at all. A record's description and
+// amount only stay valid during the call to visit. Returns false on
+// I/O error, or if the part of the file that was read is malformed.
+template <typename Visitor>
+bool stream_usda_abbrev(const std::string& path, Visitor visit) {
+	std::ifstream f(path, std::ios::in | std::ios::binary);
+	if (!f) {
+		return false;
+	}
+
+	const size_t chunk_size = 64 * 1024;
+	std::string pending;
+	UsdaAbbrevRecord record;
+	bool more = true;
+	while (more) {
+		//Append the next chunk after any partial line left over
+		const size_t kept = pending.size();
+		pending.resize(kept + chunk_size);
+		f.read(&pending[kept], chunk_size);
+		pending.resize(kept + size_t(f.gcount()));
+		more = bool(f);
+		if (!more && !f.eof()) {
+			return false;
+		}
+
+		const char* begin = pending.data();
+		const char* end = begin + pending.size();
+		while (begin != end) {
+			const char* newline = static_cast<const char*>(
+				std::memchr(begin, '\n', end - begin));
+			if (!newline && more) {
+				break;
+			}
+			const char* line_end = newline ? newline : end;
+			switch (parse_usda_abbrev_line(begin, line_end, record)) {
+			case UsdaAbbrevLine::VALID:
+				if (!visit(record)) {
+					return true;
+				}
+				break;
+			case UsdaAbbrevLine::INCOMPLETE:
+				break;
+			case UsdaAbbrevLine::MALFORMED:
+				return false;
+			}
+			begin = newline ? newline + 1 : end;
+		}
+		pending.erase(0, begin - pending.data());
+	}
+	return true;
+}
+
+// Load the same foods as filter_food_vector(*load_usda_abbrev(path),
+// min_kcal, max_kcal, total_size), filtering while parsing. Foods
+// outside the kcal range are never materialized, and parsing stops as
+// soon as total_size foods have been found, so a small total_size
+// only parses the first part of the file. Returns nullptr on I/O error
+// or a malformed file.
+std::unique_ptr<FoodVector> load_usda_abbrev_filtered(const std::string& path,
+	int min_kcal,
+	int max_kcal,
+	int total_size) {
+	std::unique_ptr<FoodVector> result(new FoodVector);
+	const size_t cap = total_size;
+	if (cap == 0) {
+		if (!std::ifstream(path)) {
+			return nullptr;
+		}
+		return result;
+	}
+
+	if (!stream_usda_abbrev(path, [&](const UsdaAbbrevRecord& record) {
+		if (record.kcal > min_kcal && record.kcal <= max_kcal) {
+			result->push_back(std::shared_ptr<Food>(new Food(
+				std::string(record.description, record.description_size),
+				std::string(record.amount, record.amount_size),
+				record.amount_g,
+				record.kcal,
+				record.protein_g)));
+		}
+		return result->size() != cap;
+	})) {
+		return nullptr;
+	}
+	return result;
+}
+
+// Header of a compiled food database file, written by compile_food_db
+// and read by load_food_db. The file is laid out as:
+//
+//    FoodDbHeader
+//    int32_t amount_g[count]
+//    int32_t kcal[count]
+//    int32_t protein_g[count]
+//    uint32_t offsets[2*count+1]   (as in FoodTable)
+//    char strings[strings_size]
+//
+// Everything is in the byte order of the machine that compiled it;
+// the magic string doubles as a check for that.
+struct FoodDbHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+	uint64_t strings_size;
+	uint64_t reserved;
+};
+
+const char FOOD_DB_MAGIC[8] = { 'M', 'X', 'P', 'R', 'O', 'T', 'D', 'B' };
+const uint32_t FOOD_DB_VERSION = 1;
+
+// Serialize table in the compiled food database format.
+std::string serialize_food_db(const FoodTable& table) {
+	FoodDbHeader header;
+	std::memcpy(header.magic, FOOD_DB_MAGIC, sizeof(header.magic));
+	header.version = FOOD_DB_VERSION;
+	header.count = table.size();
+	header.strings_size = table.strings().size();
+	header.reserved = 0;
+
+	const size_t n = table.size();
+	std::string bytes;
+	bytes.reserve(sizeof(header) + 3 * n * sizeof(int32_t) +
+		(2 * n + 1) * sizeof(uint32_t) + table.strings().size());
+	bytes.append(reinterpret_cast<const char*>(&header), sizeof(header));
+	bytes.append(reinterpret_cast<const char*>(table.amount_g_data()), n * sizeof(int32_t));
+	bytes.append(reinterpret_cast<const char*>(table.kcal_data()), n * sizeof(int32_t));
+	bytes.append(reinterpret_cast<const char*>(table.protein_g_data()), n * sizeof(int32_t));
+	bytes.append(reinterpret_cast<const char*>(table.offsets_data()), (2 * n + 1) * sizeof(uint32_t));
+	bytes.append(table.strings());
+	return bytes;
+}
+
+// Write table to db_path as a compiled food database. Returns false on
+// I/O error.
+bool compile_food_db(const FoodTable& table, const std::string& db_path) {
+	std::ofstream f(db_path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!f) {
+		return false;
+	}
+	const std::string bytes = serialize_food_db(table);
+	f.write(bytes.data(), bytes.size());
+	return bool(f);
+}
+
+// The offline step: convert the ABBREV file at abbrev_path into a
+// compiled food database at db_path. Returns false on I/O error or if
+// the ABBREV file is malformed.
+bool compile_food_db(const std::string& abbrev_path, const std::string& db_path) {
+	auto table = load_usda_abbrev_table(abbrev_path);
+	return table && compile_food_db(*table, db_path);
+}
+
+// Read-only view of a compiled food database. Opening one maps the
+// file into memory where the platform supports it, and otherwise reads
+// it with one bulk read; either way the columns are used in place, so
+// there is no per-record parsing, and processes that map the same file
+// share one copy in the page cache. The accessors match FoodTable's,
+// and to_table() copies the columns into a FoodTable for the solvers.
+class FoodDatabase {
+private:
+	// Bytes of the database, owned when not mapped.
+	std::string _buffer;
+
+	// Memory mapping backing the bytes, or nullptr.
+	void* _mapping;
+	size_t _mapping_size;
+
+	size_t _size;
+	const int32_t* _amount_g;
+	const int32_t* _kcal;
+	const int32_t* _protein_g;
+	const uint32_t* _offsets;
+	const char* _strings;
+
+	void unmap() {
+#if defined(__unix__) || defined(__APPLE__)
+		if (_mapping != nullptr)
+			munmap(_mapping, _mapping_size);
+#endif
+		_mapping = nullptr;
+		_mapping_size = 0;
+	}
+
+	// Check the database in [bytes, bytes+size) and point the columns
+	// into it. Returns false if it is not a valid database.
+	bool attach(const char* bytes, size_t size) {
+		FoodDbHeader header;
+		if (size < sizeof(header)) {
+			return false;
+		}
+		std::memcpy(&header, bytes, sizeof(header));
+		if (std::memcmp(header.magic, FOOD_DB_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != FOOD_DB_VERSION) {
+			return false;
+		}
+		//count has 32 bits, so the columns fit in 64 bits, but
+		//strings_size can be anything, so subtract instead of adding
+		const uint64_t n = header.count,
+			columns = 3 * n * sizeof(int32_t) + (2 * n + 1) * sizeof(uint32_t);
+		if (size - sizeof(header) < columns ||
+			header.strings_size != size - sizeof(header) - columns) {
+			return false;
+		}
+
+		const char* column = bytes + sizeof(header);
+		_amount_g = reinterpret_cast<const int32_t*>(column);
+		_kcal = _amount_g + n;
+		_protein_g = _kcal + n;
+		_offsets = reinterpret_cast<const uint32_t*>(_protein_g + n);
+		_strings = reinterpret_cast<const char*>(_offsets + 2 * n + 1);
+		//Every string must lie inside the pool
+		if (_offsets[0] != 0 || _offsets[2 * n] != header.strings_size) {
+			return false;
+		}
+		for (uint64_t i = 0; i < 2 * n; i++) {
+			if (_offsets[i] > _offsets[i + 1]) {
+				return false;
+			}
+		}
+		_size = n;
+		return true;
+	}
+
+	FoodDatabase(const FoodDatabase&) = delete;
+	FoodDatabase& operator=(const FoodDatabase&) = delete;
+
+public:
+	FoodDatabase()
+		: _mapping(nullptr),
+		_mapping_size(0),
+		_size(0),
+		_amount_g(nullptr),
+		_kcal(nullptr),
+		_protein_g(nullptr),
+		_offsets(nullptr),
+		_strings(nullptr) { }
+
+	~FoodDatabase() { unmap(); }
+
+	// Open the compiled database at db_path. Returns false on I/O
+	// error, or if the file is not a database of this version.
+	bool open(const std::string& db_path) {
+		unmap();
+		_buffer.clear();
+		_size = 0;
+#if defined(__unix__) || defined(__APPLE__)
+		int fd = ::open(db_path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+			close(fd);
+			return false;
+		}
+		void* mapping = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (mapping == MAP_FAILED) {
+			return false;
+		}
+		_mapping = mapping;
+		_mapping_size = size_t(info.st_size);
+		if (!attach(static_cast<const char*>(_mapping), _mapping_size)) {
+			unmap();
+			return false;
+		}
+		return true;
+#else
+		return read_file(db_path, _buffer) &&
+			attach(_buffer.data(), _buffer.size());
+#endif
+	}
+
+	// Hold a copy of table, in the same format as a compiled database.
+	void assign(const FoodTable& table) {
+		unmap();
+		_buffer = serialize_food_db(table);
+		bool valid = attach(_buffer.data(), _buffer.size());
+		assert(valid);
+		(void)valid;
+	}
+
+	// Whether the database is backed by a memory-mapped file.
+	bool mapped() const { return _mapping != nullptr; }
+
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0; }
+
+	int amount_g(size_t i) const { return _amount_g[i]; }
+	int kcal(size_t i) const { return _kcal[i]; }
+	int protein_g(size_t i) const { return _protein_g[i]; }
+
+	std::string description(size_t i) const {
+		return std::string(_strings + _offsets[2 * i], _offsets[2 * i + 1] - _offsets[2 * i]);
+	}
+	std::string amount(size_t i) const {
+		return std::string(_strings + _offsets[2 * i + 1], _offsets[2 * i + 2] - _offsets[2 * i + 1]);
+	}
+
+	const int32_t* kcal_data() const { return _kcal; }
+	const int32_t* protein_g_data() const { return _protein_g; }
+
+	// Copy the columns into a FoodTable, with memcpy-speed bulk copies.
+	FoodTable to_table() const {
+		return FoodTable(_size, _amount_g, _kcal, _protein_g, _offsets, _strings);
+	}
+
+	std::unique_ptr<FoodVector> to_food_vector() const {
+		return to_table().to_food_vector();
+	}
+};
+
+// Return the modification time of the file at path, or -1 if it
+// cannot be read.
+double file_modification_time(const std::string& path) {
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return -1;
+	}
+	return double(info.st_mtime);
+}
+
+// Load the food database, preferring the compiled file at db_path.
+// When that file is missing, invalid, or older than the ABBREV file at
+// abbrev_path, fall back to parsing abbrev_path with load_usda_abbrev.
+// Returns nullptr when neither can be loaded.
+std::unique_ptr<FoodDatabase> load_food_db(const std::string& db_path,
+	const std::string& abbrev_path) {
+	std::unique_ptr<FoodDatabase> result(new FoodDatabase);
+
+	const double db_time = file_modification_time(db_path),
+		abbrev_time = file_modification_time(abbrev_path);
+	if (db_time >= 0 && db_time >= abbrev_time && result->open(db_path)) {
+		return result;
+	}
+
+	auto foods = load_usda_abbrev(abbrev_path);
+	if (!foods) {
+		return nullptr;
+	}
+	result->assign(FoodTable(*foods));
+	return result;
+}
+
 // Convenience function to compute the total kilocalories and protein
 // in a FoodVector. Those values are returned through the
 // first two pass-by-reference arguments.
@@ -197,72 +1057,573 @@ std::unique_ptr<FoodVector> filter_food_vector(const FoodVector& source,
 	std::unique_ptr<FoodVector> result(new FoodVector);
 	//Loads from source argument, the result vector of the proper food items with
 	// the correct caloric intake specifications 
+	// Stops scanning source as soon as the result is full
+	const size_t cap = total_size;
 	for (auto& food : source) {
+		if (result->size() == cap)
+			break;
 		if (food->kcal() > min_kcal 
-			&& food->kcal() <= max_kcal 
-			&& result->size() != total_size)
+			&& food->kcal() <= max_kcal)
 			result->push_back(food);
 	}
 	//Return the filtered food vector
 	return result;
 }
 
-// Compute the optimal set of foods with a greedy
-// algorithm. Specifically, among the food items that fit within a
-// total_kcal calorie budget, choose the food whose protein is
-// greatest. Repeat until no more foods can be chosen, either because
-// we've run out of foods, or run out of calories.
-std::unique_ptr<FoodVector> greedy_max_protein(const FoodVector& foods,
-	int total_kcal) {
-	FoodVector todo = foods;
-	std::unique_ptr<FoodVector> result (new FoodVector);
-	int result_cal = 0, index, counter;
-	//Loops until we have run out of foods
-	while (!todo.empty()) {
-		index = 0;
-		counter = 0;
-		std::shared_ptr<Food> f (new Food(" "," ",0,0,0));
-		//for each food in todo, food will become every 
-		//single object in the vector
-		for (auto& food : todo) {
-			//finds the newest higher protein items 
-			if (food->protein_g() > f->protein_g()) {
-				f = food;
-				index = counter;
-			}
-			counter++;
-		}
-		//End of the range which is the end of the list
-		todo.erase(todo.begin() + index);
-		//keeps track of our calorie budget 
-		if (result_cal + f->kcal() <= total_kcal) {
-			result->push_back(f);
-			result_cal += f->kcal();
+// Index over a FoodVector, sorted by kcal, that answers the same
+// queries as filter_food_vector without scanning the whole vector.
+// Building the index takes O(n log n) time once; after that, each
+// filter() call finds the foods in its kcal window with two binary
+// searches, and only sorts the matching foods back into their original
+// order. This pays off when many filters with different kcal windows
+// run against the same loaded database.
+class KcalIndex {
+private:
+	// The indexed foods, in their original order.
+	FoodVector _foods;
+
+	// Indices into _foods, sorted by kcal and then by index.
+	IndexVector _order;
+
+	// _kcal[i] is the kcal of _foods[_order[i]].
+	std::vector<int> _kcal;
+
+public:
+	explicit KcalIndex(const FoodVector& foods)
+		: _foods(foods),
+		_order(foods.size()) {
+
+		for (int i = 0; i < int(_order.size()); i++)
+			_order[i] = i;
+		std::stable_sort(_order.begin(), _order.end(), [&](int a, int b) {
+			return _foods[a]->kcal() < _foods[b]->kcal();
+		});
+		_kcal.reserve(_order.size());
+		for (int i : _order)
+			_kcal.push_back(_foods[i]->kcal());
+	}
+
+	size_t size() const { return _foods.size(); }
+
+	// Return the same result as filter_food_vector(foods, min_kcal,
+	// max_kcal, total_size): the first total_size foods, in their
+	// original order, with more than min_kcal and at most max_kcal
+	// kilocalories.
+	std::unique_ptr<FoodVector> filter(int min_kcal,
+		int max_kcal,
+		int total_size) const {
+		auto first = std::upper_bound(_kcal.begin(), _kcal.end(), min_kcal),
+			last = std::upper_bound(_kcal.begin(), _kcal.end(), max_kcal);
+		IndexVector matches;
+		if (first < last) {
+			matches.assign(_order.begin() + (first - _kcal.begin()),
+				_order.begin() + (last - _kcal.begin()));
+		}
+
+		//Keep only the total_size matches that come first in _foods
+		const size_t cap = total_size;
+		if (matches.size() > cap) {
+			std::nth_element(matches.begin(), matches.begin() + cap, matches.end());
+			matches.resize(cap);
 		}
+		std::sort(matches.begin(), matches.end());
+		return select_foods(_foods, matches);
 	}
-	return result;
+};
+
+// Return whether a food with protein_a grams of protein and kcal_a
+// kilocalories has strictly more protein per kilocalorie than a food
+// with protein_b and kcal_b. The ratios are compared exactly, in
+// integers. Foods without protein come last, and among foods with
+// protein, those without kilocalories come first.
+bool denser(int protein_a, int kcal_a, int protein_b, int kcal_b) {
+	if (protein_a == 0 || protein_b == 0)
+		return protein_a > 0 && protein_b == 0;
+	return int64_t(protein_a) * kcal_b > int64_t(protein_b) * kcal_a;
 }
 
-// Compute the optimal set of foods with an exhaustive search
-// algorithm. Specifically, among all subsets of foods, return the
-// subset whose calories fit within the total_kcal budget, and whose
-// total protein is greatest. To avoid overflow, the size of the foods
-// vector must be less than 64.
-std::unique_ptr<FoodVector> exhaustive_max_protein(const FoodVector& foods,
-	int total_kcal) {
-	//declares the n to the size of the food vector
-	const int n = foods.size();
-	assert(n < 64);
-	//Declares the variables used within the sum food vector function
-	int cand_calories, cand_protein, best_calories, best_protein;
-	//Declares the best food vector unique pointer
-	std::unique_ptr<FoodVector> best (new FoodVector);
-	//Creates power to be 2^n
-	double power = pow(2, n);
-	//Subset generating nested for loop
-	for (uint64_t bits = 0; bits < power; bits++) {
-		std::unique_ptr<FoodVector> candidate (new FoodVector);
-		for (int j = 0; j < n; j++) {
+// Replace rows with the indices, in order, of the foods that can be
+// part of a solution within total_kcal: those with protein and at most
+// total_kcal kilocalories.
+void usable_foods(const FoodTable& foods, int total_kcal, IndexVector& rows) {
+	rows.clear();
+	for (int i = 0; i < int(foods.size()); i++) {
+		if (foods.protein_g(i) > 0 && foods.kcal(i) <= total_kcal)
+			rows.push_back(i);
+	}
+}
+
+// Return the LP relaxation bound for foods under total_kcal: the
+// protein of the densest foods that fit, plus the fraction of the next
+// one that fills the rest of the budget. No subset has more protein.
+double lp_relaxation_bound(const FoodTable& foods, int total_kcal) {
+	if (total_kcal < 0) {
+		return 0;
+	}
+	IndexVector order;
+	for (int i = 0; i < int(foods.size()); i++) {
+		if (foods.protein_g(i) > 0)
+			order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) {
+		return denser(foods.protein_g(a), foods.kcal(a), foods.protein_g(b), foods.kcal(b));
+	});
+	double protein_g = 0;
+	int remaining = total_kcal;
+	for (int i : order) {
+		if (foods.kcal(i) <= remaining) {
+			remaining -= foods.kcal(i);
+			protein_g += foods.protein_g(i);
+		}
+		else {
+			protein_g += double(remaining) * foods.protein_g(i) / foods.kcal(i);
+			break;
+		}
+	}
+	return protein_g;
+}
+
+// Phases of a request that SolveStats can time.
+enum class StatsPhase {
+	LOAD,
+	FILTER,
+	SOLVE
+};
+
+// Per-solve instrumentation, as a policy. Solvers that take a
+// SolveStats<ENABLED>& call its hooks on their hot paths. The
+// SolveStats<false> specialization, NullStats, is empty and every hook
+// is an empty inline function, so solvers instantiated with it compile
+// to exactly the uninstrumented code; SolveStats<true>, CountingStats,
+// records the counters. Each counter is only filled in by the solvers
+// that measure it.
+template <bool ENABLED>
+class SolveStats;
+
+template <>
+class SolveStats<false> {
+public:
+	static const bool enabled = false;
+
+	void visit(uint64_t = 1) { }
+	void prune(uint64_t = 1) { }
+	void touch_cells(int64_t count) { assert(count >= 0); (void)count; }
+	void allocate(size_t) { }
+	void release(size_t) { }
+	void begin_phase() { }
+	void end_phase(StatsPhase) { }
+	void finish(int, double) { }
+};
+
+template <>
+class SolveStats<true> {
+private:
+	size_t _scratch_bytes;
+	Timer _phase_timer;
+
+public:
+	static const bool enabled = true;
+
+	// Subsets or search nodes visited, and search nodes pruned.
+	uint64_t visited, pruned;
+
+	// Dynamic programming cells updated.
+	uint64_t dp_cells;
+
+	// The most scratch memory in use at once, in bytes.
+	size_t peak_scratch_bytes;
+
+	// Seconds spent in each StatsPhase.
+	double load_seconds, filter_seconds, solve_seconds;
+
+	// Protein of the answer, the LP relaxation bound, and the
+	// optimality gap between them as a fraction of the bound.
+	int protein_g;
+	double lp_bound, gap;
+
+	SolveStats() {
+		reset();
+	}
+
+	void reset() {
+		_scratch_bytes = 0;
+		visited = pruned = dp_cells = 0;
+		peak_scratch_bytes = 0;
+		load_seconds = filter_seconds = solve_seconds = 0;
+		protein_g = 0;
+		lp_bound = gap = 0;
+	}
+
+	void visit(uint64_t count = 1) { visited += count; }
+	void prune(uint64_t count = 1) { pruned += count; }
+	// Record count DP cells updated. count is signed so that a negative
+	// one from a caller's arithmetic is caught rather than wrapping.
+	void touch_cells(int64_t count) {
+		assert(count >= 0);
+		dp_cells += uint64_t(count);
+	}
+
+	void allocate(size_t bytes) {
+		_scratch_bytes += bytes;
+		peak_scratch_bytes = std::max(peak_scratch_bytes, _scratch_bytes);
+	}
+
+	void release(size_t bytes) {
+		assert(bytes <= _scratch_bytes);
+		_scratch_bytes -= bytes;
+	}
+
+	// Start timing a phase; end_phase adds the time since to phase.
+	void begin_phase() { _phase_timer.reset(); }
+
+	void end_phase(StatsPhase phase) {
+		const double elapsed = _phase_timer.elapsed();
+		switch (phase) {
+		case StatsPhase::LOAD: load_seconds += elapsed; break;
+		case StatsPhase::FILTER: filter_seconds += elapsed; break;
+		case StatsPhase::SOLVE: solve_seconds += elapsed; break;
+		}
+	}
+
+	// Record the answer's protein and the LP bound of its problem.
+	void finish(int protein, double bound) {
+		protein_g = protein;
+		lp_bound = bound;
+		gap = (bound > 0) ? (bound - protein) / bound : 0;
+	}
+};
+
+typedef SolveStats<false> NullStats;
+typedef SolveStats<true> CountingStats;
+
+// Call stats.finish for selection, an answer for foods under
+// total_kcal; the LP bound is only computed if stats is enabled.
+template <bool ENABLED>
+void finish_stats(SolveStats<ENABLED>& stats,
+	const FoodTable& foods,
+	int total_kcal,
+	const IndexVector& selection) {
+	if (!SolveStats<ENABLED>::enabled)
+		return;
+	int protein_g = 0;
+	for (int i : selection)
+		protein_g += foods.protein_g(i);
+	stats.finish(protein_g, lp_relaxation_bound(foods, total_kcal));
+}
+
+// Rules greedy_max_protein can use to choose the next food.
+enum class GreedyStrategy {
+	// The food with the most protein.
+	PROTEIN,
+
+	// The food with the most protein per kilocalorie.
+	DENSITY,
+
+	// Whichever is better of the DENSITY result and the single food
+	// with the most protein that fits the budget. This is guaranteed
+	// to find at least half of the optimal total protein.
+	BEST_OF_BOTH
+};
+
+// Fill order with the order in which greedy_max_protein considers
+// foods under strategy, which must be PROTEIN or DENSITY.
+void greedy_order(const FoodTable& foods,
+	GreedyStrategy strategy,
+	IndexVector& order) {
+	assert(strategy != GreedyStrategy::BEST_OF_BOTH);
+
+	//Breaking ties by index keeps tied foods in their original order,
+	//the order repeated scans for the next food would pick them, and
+	//unlike std::stable_sort needs no temporary buffer
+	const int32_t* kcal = foods.kcal_data();
+	const int32_t* protein_g = foods.protein_g_data();
+	order.resize(foods.size());
+	for (int i = 0; i < int(order.size()); i++)
+		order[i] = i;
+	if (strategy == GreedyStrategy::DENSITY) {
+		std::sort(order.begin(), order.end(), [&](int a, int b) {
+			if (denser(protein_g[a], kcal[a], protein_g[b], kcal[b]))
+				return true;
+			if (denser(protein_g[b], kcal[b], protein_g[a], kcal[a]))
+				return false;
+			return a < b;
+		});
+	}
+	else {
+		std::sort(order.begin(), order.end(), [&](int a, int b) {
+			if (protein_g[a] != protein_g[b])
+				return protein_g[a] > protein_g[b];
+			return a < b;
+		});
+	}
+}
+
+IndexVector greedy_order(const FoodTable& foods, GreedyStrategy strategy) {
+	IndexVector order;
+	greedy_order(foods, strategy, order);
+	return order;
+}
+
+// Make one greedy pass over foods in the given order, from
+// greedy_order, taking every food with protein that still fits within
+// total_kcal. The chosen foods replace the contents of result.
+void greedy_fill(const FoodTable& foods,
+	const IndexVector& order,
+	int total_kcal,
+	IndexVector& result) {
+	const int32_t* kcal = foods.kcal_data();
+	const int32_t* protein_g = foods.protein_g_data();
+	result.clear();
+	int result_cal = 0;
+	for (int i : order) {
+		//The remaining foods have no protein either
+		if (protein_g[i] == 0)
+			break;
+		//keeps track of our calorie budget 
+		if (result_cal + kcal[i] <= total_kcal) {
+			result.push_back(i);
+			result_cal += kcal[i];
+		}
+	}
+}
+
+IndexVector greedy_fill(const FoodTable& foods,
+	const IndexVector& order,
+	int total_kcal) {
+	IndexVector result;
+	greedy_fill(foods, order, total_kcal, result);
+	return result;
+}
+
+// Finish the BEST_OF_BOTH strategy: replace by_density, the DENSITY
+// result, with the single food with the most protein that fits within
+// total_kcal if that food has more protein on its own.
+void best_of_both(const FoodTable& foods,
+	int total_kcal,
+	IndexVector& by_density) {
+	int density_protein = 0;
+	for (int i : by_density)
+		density_protein += foods.protein_g(i);
+
+	int single = -1;
+	for (int i = 0; i < int(foods.size()); i++) {
+		if (foods.kcal(i) <= total_kcal &&
+			foods.protein_g(i) > (single < 0 ? 0 : foods.protein_g(single)))
+			single = i;
+	}
+	if (single >= 0 && foods.protein_g(single) > density_protein)
+		by_density.assign(1, single);
+}
+
+// Compute the optimal set of foods with a greedy
+// algorithm. Specifically, among the food items that fit within a
+// total_kcal calorie budget, choose the food whose protein is
+// greatest. Repeat until no more foods can be chosen, either because
+// we've run out of foods, or run out of calories. The strategy
+// parameter can select a different rule for the next food instead;
+// see GreedyStrategy. Ties go to the food that comes first in foods,
+// and foods are returned in the order they were chosen. Rather than
+// scanning for the next food on every step, the foods are sorted once,
+// so every strategy takes O(n log n) time. Foods without protein
+// never add any, so they are not chosen.
+IndexVector greedy_max_protein(const FoodTable& foods,
+	int total_kcal,
+	GreedyStrategy strategy = GreedyStrategy::PROTEIN) {
+	if (strategy == GreedyStrategy::BEST_OF_BOTH) {
+		IndexVector result = greedy_fill(foods,
+			greedy_order(foods, GreedyStrategy::DENSITY), total_kcal);
+		best_of_both(foods, total_kcal, result);
+		return result;
+	}
+	return greedy_fill(foods, greedy_order(foods, strategy), total_kcal);
+}
+
+std::unique_ptr<FoodVector> greedy_max_protein(const FoodVector& foods,
+	int total_kcal,
+	GreedyStrategy strategy = GreedyStrategy::PROTEIN) {
+	return select_foods(foods,
+		greedy_max_protein(FoodTable::numbers(foods), total_kcal, strategy));
+}
+
+// Compute greedy_max_protein(foods, budget, strategy) for every budget
+// in budgets, in one call. The foods are sorted once, which is the
+// expensive part, and then each budget takes a single linear pass.
+std::vector<IndexVector> greedy_max_protein_batch(const FoodTable& foods,
+	const std::vector<int>& budgets,
+	GreedyStrategy strategy = GreedyStrategy::PROTEIN) {
+	const IndexVector order = greedy_order(foods,
+		strategy == GreedyStrategy::BEST_OF_BOTH ? GreedyStrategy::DENSITY : strategy);
+	std::vector<IndexVector> result;
+	result.reserve(budgets.size());
+	for (int budget : budgets) {
+		IndexVector chosen = greedy_fill(foods, order, budget);
+		if (strategy == GreedyStrategy::BEST_OF_BOTH)
+			best_of_both(foods, budget, chosen);
+		result.push_back(chosen);
+	}
+	return result;
+}
+
+std::vector<std::unique_ptr<FoodVector>> greedy_max_protein_batch(const FoodVector& foods,
+	const std::vector<int>& budgets,
+	GreedyStrategy strategy = GreedyStrategy::PROTEIN) {
+	std::vector<std::unique_ptr<FoodVector>> result;
+	for (auto& chosen : greedy_max_protein_batch(FoodTable::numbers(foods), budgets, strategy))
+		result.push_back(select_foods(foods, chosen));
+	return result;
+}
+
+// Improve selection, a set of food indices whose kilocalories fit
+// within total_kcal such as a greedy_max_protein result, by local
+// search. Each round applies the best of three kinds of move: add one
+// unselected food, swap one selected food for one unselected food, or
+// swap two selected foods for one unselected food, and rounds repeat
+// until no move adds protein. Unselected foods are kept sorted by kcal
+// with a running maximum of protein, so the best food fitting any
+// slack is one binary search away, and a round costs
+// O(n + m^2 log n) for m selected foods. The result never has less
+// protein than selection, and is returned in ascending index order.
+IndexVector local_search_improve(const FoodTable& foods,
+	int total_kcal,
+	const IndexVector& selection) {
+	const int n = foods.size();
+	std::vector<char> selected(n, 0);
+	int kcal = 0;
+	for (int i : selection) {
+		assert(i >= 0 && i < n);
+		if (!selected[i]) {
+			selected[i] = 1;
+			kcal += foods.kcal(i);
+		}
+	}
+	assert(kcal <= total_kcal);
+
+	IndexVector by_kcal(n);
+	for (int i = 0; i < n; i++)
+		by_kcal[i] = i;
+	std::sort(by_kcal.begin(), by_kcal.end(), [&](int a, int b) {
+		return foods.kcal(a) < foods.kcal(b);
+	});
+	std::vector<int> sorted_kcal(n);
+	for (int t = 0; t < n; t++)
+		sorted_kcal[t] = foods.kcal(by_kcal[t]);
+
+	//best_prefix[t] is the unselected food with the most protein among
+	//by_kcal[0, t], or -1 for none
+	IndexVector best_prefix(n);
+	IndexVector chosen;
+	for (;;) {
+		int best = -1;
+		for (int t = 0; t < n; t++) {
+			const int i = by_kcal[t];
+			if (!selected[i] && (best < 0 || foods.protein_g(i) > foods.protein_g(best)))
+				best = i;
+			best_prefix[t] = best;
+		}
+
+		//The unselected food with the most protein within slack
+		auto best_fitting = [&](int slack) {
+			const int t = std::upper_bound(sorted_kcal.begin(), sorted_kcal.end(), slack) -
+				sorted_kcal.begin();
+			return (t == 0) ? -1 : best_prefix[t - 1];
+		};
+
+		chosen.clear();
+		for (int i = 0; i < n; i++) {
+			if (selected[i])
+				chosen.push_back(i);
+		}
+
+		int best_gain = 0, add = -1, drop_a = -1, drop_b = -1;
+		const int slack = total_kcal - kcal;
+		int j = best_fitting(slack);
+		if (j >= 0 && foods.protein_g(j) > best_gain) {
+			best_gain = foods.protein_g(j);
+			add = j;
+		}
+		for (size_t a = 0; a < chosen.size(); a++) {
+			const int i = chosen[a];
+			j = best_fitting(slack + foods.kcal(i));
+			if (j >= 0 && foods.protein_g(j) - foods.protein_g(i) > best_gain) {
+				best_gain = foods.protein_g(j) - foods.protein_g(i);
+				add = j;
+				drop_a = i;
+				drop_b = -1;
+			}
+			for (size_t b = a + 1; b < chosen.size(); b++) {
+				const int k = chosen[b];
+				j = best_fitting(slack + foods.kcal(i) + foods.kcal(k));
+				if (j >= 0 &&
+					foods.protein_g(j) - foods.protein_g(i) - foods.protein_g(k) > best_gain) {
+					best_gain = foods.protein_g(j) - foods.protein_g(i) - foods.protein_g(k);
+					add = j;
+					drop_a = i;
+					drop_b = k;
+				}
+			}
+		}
+		if (add < 0)
+			break;
+
+		selected[add] = 1;
+		kcal += foods.kcal(add);
+		for (int drop : { drop_a, drop_b }) {
+			if (drop >= 0) {
+				selected[drop] = 0;
+				kcal -= foods.kcal(drop);
+			}
+		}
+		assert(kcal <= total_kcal);
+	}
+
+	IndexVector result;
+	for (int i = 0; i < n; i++) {
+		if (selected[i])
+			result.push_back(i);
+	}
+	return result;
+}
+
+// Compute greedy_max_protein(foods, total_kcal, strategy) and improve
+// it with local_search_improve. This costs a small multiple of the
+// greedy algorithm and closes most of its gap to the optimum.
+IndexVector local_search_max_protein(const FoodTable& foods,
+	int total_kcal,
+	GreedyStrategy strategy = GreedyStrategy::BEST_OF_BOTH) {
+	if (total_kcal < 0) {
+		return IndexVector();
+	}
+	return local_search_improve(foods, total_kcal,
+		greedy_max_protein(foods, total_kcal, strategy));
+}
+
+std::unique_ptr<FoodVector> local_search_max_protein(const FoodVector& foods,
+	int total_kcal,
+	GreedyStrategy strategy = GreedyStrategy::BEST_OF_BOTH) {
+	return select_foods(foods,
+		local_search_max_protein(FoodTable::numbers(foods), total_kcal, strategy));
+}
+
+// Compute the optimal set of foods with an exhaustive search
+// algorithm. Specifically, among all subsets of foods, return the
+// subset whose calories fit within the total_kcal budget, and whose
+// total protein is greatest. To avoid overflow, the size of the foods
+// vector must be less than 64.
+std::unique_ptr<FoodVector> exhaustive_max_protein(const FoodVector& foods,
+	int total_kcal) {
+	//declares the n to the size of the food vector
+	const int n = foods.size();
+	assert(n < 64);
+	//Declares the variables used within the sum food vector function
+	int cand_calories, cand_protein, best_calories, best_protein;
+	//Declares the best food vector unique pointer
+	std::unique_ptr<FoodVector> best (new FoodVector);
+	//Creates power to be 2^n
+	double power = pow(2, n);
+	//Subset generating nested for loop
+	for (uint64_t bits = 0; bits < power; bits++) {
+		std::unique_ptr<FoodVector> candidate (new FoodVector);
+		for (int j = 0; j < n; j++) {
 			//Line that generates subsets
 			if (((bits >> j) & 1) == 1)
 				//pushes all food items worthy of being a candidate
@@ -279,3 +1640,3130 @@ std::unique_ptr<FoodVector> exhaustive_max_protein(const FoodVector& foods,
 	//Return the best subsets of protein items in the food vector for the given caloric bounds 
 	return best;
 }
+
+// Return the index of the lowest set bit in x, which must be non-zero.
+int lowest_set_bit(uint64_t x) {
+	assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(x);
+#else
+	int index = 0;
+	while (!((x >> index) & 1))
+		index++;
+	return index;
+#endif
+}
+
+// Running winner of an exhaustive search, with the chosen subset
+// encoded as a bitmask over the input foods. consider() settles ties
+// the same way exhaustive_max_protein does: among the feasible
+// non-empty subsets with the most protein, the one with the smallest
+// mask wins, so the enumeration order does not affect the result.
+struct SubsetBest {
+	uint64_t mask;
+	int protein_g;
+
+	SubsetBest() : mask(0), protein_g(0) { }
+
+	// mask must be non-zero and fit within the budget.
+	void consider(uint64_t candidate_mask, int candidate_protein_g) {
+		if (candidate_protein_g > protein_g ||
+			(candidate_protein_g == protein_g &&
+			(mask == 0 || candidate_mask < mask))) {
+			mask = candidate_mask;
+			protein_g = candidate_protein_g;
+		}
+	}
+};
+
+// Convert a subset bitmask into the indices of its set bits, in
+// increasing order.
+IndexVector mask_to_indices(uint64_t mask) {
+	IndexVector result;
+	for (; mask != 0; mask &= mask - 1)
+		result.push_back(lowest_set_bit(mask));
+	return result;
+}
+
+// Compute the same result as exhaustive_max_protein over a FoodTable,
+// visiting the subsets in the same order, but reading kcal and protein
+// straight from the table's columns without building any candidate
+// FoodVector. The size of the table must be less than 64.
+IndexVector exhaustive_max_protein(const FoodTable& foods,
+	int total_kcal) {
+	const int n = foods.size();
+	assert(n < 64);
+	const int32_t* kcal = foods.kcal_data();
+	const int32_t* protein_g = foods.protein_g_data();
+
+	SubsetBest best;
+	const uint64_t end = uint64_t(1) << n;
+	for (uint64_t bits = 1; bits < end && total_kcal >= 0; bits++) {
+		int cand_kcal = 0, cand_protein = 0;
+		for (int j = 0; j < n; j++) {
+			if ((bits >> j) & 1) {
+				cand_kcal += kcal[j];
+				cand_protein += protein_g[j];
+			}
+		}
+		if (cand_kcal <= total_kcal)
+			best.consider(bits, cand_protein);
+	}
+	return mask_to_indices(best.mask);
+}
+
+// Compute the same result as exhaustive_max_protein, but visit the
+// subsets in Gray-code order. Consecutive subsets differ by exactly
+// one food, so the running kcal and protein totals are updated in O(1)
+// per subset, and the winner is kept as a bitmask that becomes a
+// list of indices only once at the end; nothing is allocated inside
+// the loop. The size of the table must be less than 64.
+// exhaustive_gray_mask returns that bitmask itself, with bit i set
+// when food i is chosen, and counts each subset in stats.
+template <bool ENABLED>
+uint64_t exhaustive_gray_mask(const FoodTable& foods,
+	int total_kcal,
+	SolveStats<ENABLED>& stats) {
+	const int n = foods.size();
+	assert(n < 64);
+	if (total_kcal < 0) {
+		return 0;
+	}
+	const int32_t* kcal = foods.kcal_data();
+	const int32_t* protein_g = foods.protein_g_data();
+
+	SubsetBest best;
+	uint64_t mask = 0;
+	int cand_kcal = 0, cand_protein = 0;
+	const uint64_t end = uint64_t(1) << n;
+	for (uint64_t k = 1; k < end; k++) {
+		//Gray code k^(k>>1) differs from the previous one in bit j
+		const int j = lowest_set_bit(k);
+		mask ^= uint64_t(1) << j;
+		if ((mask >> j) & 1) {
+			cand_kcal += kcal[j];
+			cand_protein += protein_g[j];
+		}
+		else {
+			cand_kcal -= kcal[j];
+			cand_protein -= protein_g[j];
+		}
+		stats.visit();
+		if (cand_kcal <= total_kcal)
+			best.consider(mask, cand_protein);
+	}
+	return best.mask;
+}
+
+uint64_t exhaustive_gray_mask(const FoodTable& foods,
+	int total_kcal) {
+	NullStats stats;
+	return exhaustive_gray_mask(foods, total_kcal, stats);
+}
+
+IndexVector exhaustive_max_protein_gray(const FoodTable& foods,
+	int total_kcal) {
+	return mask_to_indices(exhaustive_gray_mask(foods, total_kcal));
+}
+
+// Like exhaustive_max_protein_gray(foods, total_kcal), also recording
+// the subsets visited and the solve time in stats.
+template <bool ENABLED>
+IndexVector exhaustive_max_protein_gray(const FoodTable& foods,
+	int total_kcal,
+	SolveStats<ENABLED>& stats) {
+	stats.begin_phase();
+	IndexVector result = mask_to_indices(exhaustive_gray_mask(foods, total_kcal, stats));
+	stats.end_phase(StatsPhase::SOLVE);
+	finish_stats(stats, foods, total_kcal, result);
+	return result;
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_protein_gray(const FoodVector& foods,
+	int total_kcal) {
+	return select_foods(foods,
+		exhaustive_max_protein_gray(FoodTable::numbers(foods), total_kcal));
+}
+
+// Compute the same result as exhaustive_max_protein, using threads
+// worker threads, or one per hardware thread when threads is zero. The
+// subsets are split into blocks that share their upper bits; workers
+// claim blocks from a shared counter, so a slow worker never holds up
+// the rest, and enumerate each block in Gray-code order like
+// exhaustive_max_protein_gray. Each worker keeps its own SubsetBest,
+// and those are combined at the end. SubsetBest breaks ties by mask
+// rather than by visiting order, so the result is identical to the
+// serial one no matter how the work was split. The size of the table
+// must be less than 64.
+IndexVector exhaustive_max_protein_parallel(const FoodTable& foods,
+	int total_kcal,
+	unsigned threads = 0) {
+	const int n = foods.size();
+	assert(n < 64);
+	if (total_kcal < 0) {
+		return IndexVector();
+	}
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	const int32_t* kcal = foods.kcal_data();
+	const int32_t* protein_g = foods.protein_g_data();
+
+	//Several blocks per thread, so uneven blocks still balance out
+	int block_bits = 0;
+	while (block_bits < n && (uint64_t(1) << block_bits) < 8 * uint64_t(threads))
+		block_bits++;
+	const int low_bits = n - block_bits;
+	const uint64_t blocks = uint64_t(1) << block_bits,
+		low_end = uint64_t(1) << low_bits;
+
+	std::atomic<uint64_t> next_block(0);
+	std::vector<SubsetBest> bests(threads);
+	auto worker = [&](unsigned id) {
+		SubsetBest& best = bests[id];
+		for (uint64_t block; (block = next_block++) < blocks; ) {
+			uint64_t mask = block << low_bits;
+			int cand_kcal = 0, cand_protein = 0;
+			for (int j = low_bits; j < n; j++) {
+				if ((mask >> j) & 1) {
+					cand_kcal += kcal[j];
+					cand_protein += protein_g[j];
+				}
+			}
+			if (mask != 0 && cand_kcal <= total_kcal)
+				best.consider(mask, cand_protein);
+
+			for (uint64_t k = 1; k < low_end; k++) {
+				const int j = lowest_set_bit(k);
+				mask ^= uint64_t(1) << j;
+				if ((mask >> j) & 1) {
+					cand_kcal += kcal[j];
+					cand_protein += protein_g[j];
+				}
+				else {
+					cand_kcal -= kcal[j];
+					cand_protein -= protein_g[j];
+				}
+				if (cand_kcal <= total_kcal)
+					best.consider(mask, cand_protein);
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned id = 1; id < threads; id++)
+		pool.push_back(std::thread(worker, id));
+	worker(0);
+	for (auto& thread : pool)
+		thread.join();
+
+	SubsetBest best;
+	for (auto& partial : bests) {
+		if (partial.mask != 0)
+			best.consider(partial.mask, partial.protein_g);
+	}
+	return mask_to_indices(best.mask);
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_protein_parallel(const FoodVector& foods,
+	int total_kcal,
+	unsigned threads = 0) {
+	return select_foods(foods,
+		exhaustive_max_protein_parallel(FoodTable::numbers(foods), total_kcal, threads));
+}
+
+// Instruction sets exhaustive_max_protein_simd can use, from least to
+// most capable.
+enum class SimdLevel {
+	SCALAR,
+	AVX2,
+	AVX512
+};
+
+// Return the most capable SimdLevel the running CPU supports. The
+// check happens at run time, so one binary runs on every host.
+SimdLevel supported_simd_level() {
+#ifdef MAXPROTEIN_X86_SIMD
+	static const SimdLevel level =
+		__builtin_cpu_supports("avx512f") ? SimdLevel::AVX512 :
+		__builtin_cpu_supports("avx2") ? SimdLevel::AVX2 :
+		SimdLevel::SCALAR;
+	return level;
+#else
+	return SimdLevel::SCALAR;
+#endif
+}
+
+// Fill lane_kcal and lane_protein_g, which hold 2^low_bits entries,
+// with the totals of every subset of the first low_bits foods, and
+// consider those subsets, which are the ones whose upper bits are all
+// zero, in best.
+void simd_lane_sums(const int32_t* kcal,
+	const int32_t* protein_g,
+	int low_bits,
+	int total_kcal,
+	int32_t* lane_kcal,
+	int32_t* lane_protein_g,
+	SubsetBest& best) {
+	for (int lane = 0; lane < (1 << low_bits); lane++) {
+		lane_kcal[lane] = lane_protein_g[lane] = 0;
+		for (int j = 0; j < low_bits; j++) {
+			if ((lane >> j) & 1) {
+				lane_kcal[lane] += kcal[j];
+				lane_protein_g[lane] += protein_g[j];
+			}
+		}
+		if (lane != 0 && lane_kcal[lane] <= total_kcal)
+			best.consider(lane, lane_protein_g[lane]);
+	}
+}
+
+// Fold the per-lane winners of a SIMD kernel into best. Lane i of
+// best_high holds the upper bits of the best mask whose low bits are
+// i, and lane i of best_protein_g its protein, or -1 for none.
+void simd_reduce_lanes(int low_bits,
+	const int32_t* best_protein_g,
+	const int32_t* best_high,
+	SubsetBest& best) {
+	for (int lane = 0; lane < (1 << low_bits); lane++) {
+		if (best_protein_g[lane] >= 0) {
+			best.consider((uint64_t(uint32_t(best_high[lane])) << low_bits) | lane,
+				best_protein_g[lane]);
+		}
+	}
+}
+
+// The portable kernel behind exhaustive_max_protein_simd. The low
+// log2(LANES) bits of each mask pick a lane, so LANES consecutive masks
+// are evaluated together: the upper bits are enumerated in Gray-code
+// order with running scalar totals, and each step adds those totals to
+// per-lane constants. Every lane keeps its own best protein and upper
+// bits with the same tie-breaking as SubsetBest, and the lanes are
+// folded together at the end. The lane loops have no branches, so
+// compilers can vectorize them for whatever the target supports.
+template <int LANES, int LOW_BITS>
+void exhaustive_kernel_scalar(const int32_t* kcal,
+	const int32_t* protein_g,
+	int n,
+	int total_kcal,
+	SubsetBest& best) {
+	int32_t lane_kcal[LANES], lane_protein_g[LANES];
+	simd_lane_sums(kcal, protein_g, LOW_BITS, total_kcal, lane_kcal, lane_protein_g, best);
+
+	int32_t best_protein_g[LANES], best_high[LANES];
+	for (int lane = 0; lane < LANES; lane++) {
+		best_protein_g[lane] = -1;
+		best_high[lane] = INT32_MAX;
+	}
+
+	int32_t high = 0, high_kcal = 0, high_protein_g = 0;
+	const uint64_t end = uint64_t(1) << (n - LOW_BITS);
+	for (uint64_t k = 1; k < end; k++) {
+		const int j = lowest_set_bit(k);
+		high ^= int32_t(1) << j;
+		const int32_t sign = ((high >> j) & 1) ? 1 : -1;
+		high_kcal += sign * kcal[LOW_BITS + j];
+		high_protein_g += sign * protein_g[LOW_BITS + j];
+		for (int lane = 0; lane < LANES; lane++) {
+			const int32_t cand_kcal = high_kcal + lane_kcal[lane];
+			const int32_t cand_protein = (cand_kcal <= total_kcal) ?
+				high_protein_g + lane_protein_g[lane] : -1;
+			const bool better = cand_protein > best_protein_g[lane] ||
+				(cand_protein == best_protein_g[lane] && high < best_high[lane]);
+			best_protein_g[lane] = better ? cand_protein : best_protein_g[lane];
+			best_high[lane] = better ? high : best_high[lane];
+		}
+	}
+	simd_reduce_lanes(LOW_BITS, best_protein_g, best_high, best);
+}
+
+#ifdef MAXPROTEIN_X86_SIMD
+
+// AVX2 version of exhaustive_kernel_scalar, with 8 lanes.
+__attribute__((target("avx2")))
+void exhaustive_kernel_avx2(const int32_t* kcal,
+	const int32_t* protein_g,
+	int n,
+	int total_kcal,
+	SubsetBest& best) {
+	const int low_bits = 3;
+	alignas(32) int32_t lane_kcal[8], lane_protein_g[8];
+	simd_lane_sums(kcal, protein_g, low_bits, total_kcal, lane_kcal, lane_protein_g, best);
+
+	const __m256i lanes_kcal = _mm256_load_si256(reinterpret_cast<const __m256i*>(lane_kcal)),
+		lanes_protein_g = _mm256_load_si256(reinterpret_cast<const __m256i*>(lane_protein_g)),
+		limit = _mm256_set1_epi32(total_kcal);
+	__m256i best_protein_g = _mm256_set1_epi32(-1),
+		best_high = _mm256_set1_epi32(INT32_MAX);
+
+	int32_t high = 0, high_kcal = 0, high_protein_g = 0;
+	const uint64_t end = uint64_t(1) << (n - low_bits);
+	for (uint64_t k = 1; k < end; k++) {
+		const int j = lowest_set_bit(k);
+		high ^= int32_t(1) << j;
+		const int32_t sign = ((high >> j) & 1) ? 1 : -1;
+		high_kcal += sign * kcal[low_bits + j];
+		high_protein_g += sign * protein_g[low_bits + j];
+
+		const __m256i cand_kcal = _mm256_add_epi32(_mm256_set1_epi32(high_kcal), lanes_kcal);
+		//Lanes over the budget become all ones, i.e. protein -1
+		const __m256i cand_protein = _mm256_or_si256(
+			_mm256_add_epi32(_mm256_set1_epi32(high_protein_g), lanes_protein_g),
+			_mm256_cmpgt_epi32(cand_kcal, limit));
+		const __m256i high_vector = _mm256_set1_epi32(high);
+		const __m256i better = _mm256_or_si256(
+			_mm256_cmpgt_epi32(cand_protein, best_protein_g),
+			_mm256_and_si256(_mm256_cmpeq_epi32(cand_protein, best_protein_g),
+				_mm256_cmpgt_epi32(best_high, high_vector)));
+		best_protein_g = _mm256_blendv_epi8(best_protein_g, cand_protein, better);
+		best_high = _mm256_blendv_epi8(best_high, high_vector, better);
+	}
+
+	alignas(32) int32_t lane_best_protein_g[8], lane_best_high[8];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lane_best_protein_g), best_protein_g);
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lane_best_high), best_high);
+	simd_reduce_lanes(low_bits, lane_best_protein_g, lane_best_high, best);
+}
+
+// AVX-512 version of exhaustive_kernel_scalar, with 16 lanes.
+__attribute__((target("avx512f")))
+void exhaustive_kernel_avx512(const int32_t* kcal,
+	const int32_t* protein_g,
+	int n,
+	int total_kcal,
+	SubsetBest& best) {
+	const int low_bits = 4;
+	alignas(64) int32_t lane_kcal[16], lane_protein_g[16];
+	simd_lane_sums(kcal, protein_g, low_bits, total_kcal, lane_kcal, lane_protein_g, best);
+
+	const __m512i lanes_kcal = _mm512_load_si512(lane_kcal),
+		lanes_protein_g = _mm512_load_si512(lane_protein_g),
+		limit = _mm512_set1_epi32(total_kcal),
+		none = _mm512_set1_epi32(-1);
+	__m512i best_protein_g = none,
+		best_high = _mm512_set1_epi32(INT32_MAX);
+
+	int32_t high = 0, high_kcal = 0, high_protein_g = 0;
+	const uint64_t end = uint64_t(1) << (n - low_bits);
+	for (uint64_t k = 1; k < end; k++) {
+		const int j = lowest_set_bit(k);
+		high ^= int32_t(1) << j;
+		const int32_t sign = ((high >> j) & 1) ? 1 : -1;
+		high_kcal += sign * kcal[low_bits + j];
+		high_protein_g += sign * protein_g[low_bits + j];
+
+		const __m512i cand_kcal = _mm512_add_epi32(_mm512_set1_epi32(high_kcal), lanes_kcal);
+		const __m512i cand_protein = _mm512_mask_mov_epi32(
+			_mm512_add_epi32(_mm512_set1_epi32(high_protein_g), lanes_protein_g),
+			_mm512_cmpgt_epi32_mask(cand_kcal, limit),
+			none);
+		const __m512i high_vector = _mm512_set1_epi32(high);
+		const __mmask16 better = _mm512_cmpgt_epi32_mask(cand_protein, best_protein_g) |
+			(_mm512_cmpeq_epi32_mask(cand_protein, best_protein_g) &
+			_mm512_cmpgt_epi32_mask(best_high, high_vector));
+		best_protein_g = _mm512_mask_mov_epi32(best_protein_g, better, cand_protein);
+		best_high = _mm512_mask_mov_epi32(best_high, better, high_vector);
+	}
+
+	alignas(64) int32_t lane_best_protein_g[16], lane_best_high[16];
+	_mm512_store_si512(lane_best_protein_g, best_protein_g);
+	_mm512_store_si512(lane_best_high, best_high);
+	simd_reduce_lanes(low_bits, lane_best_protein_g, lane_best_high, best);
+}
+
+#endif
+
+// Compute the same result as exhaustive_max_protein with a vectorized
+// kernel that evaluates 8 (AVX2) or 16 (AVX-512) consecutive masks per
+// step. level caps the instruction set used; by default it is the best
+// one the CPU supports, detected at run time, and a level the CPU does
+// not support is lowered to one it does. Inputs too small to fill the
+// lanes, or larger than 34 foods, which would not finish anyway, use
+// exhaustive_max_protein_gray instead. The size of the table must be
+// less than 64. exhaustive_simd_mask returns the winning bitmask.
+uint64_t exhaustive_simd_mask(const FoodTable& foods,
+	int total_kcal,
+	SimdLevel level = supported_simd_level()) {
+	const int n = foods.size();
+	assert(n < 64);
+	if (total_kcal < 0) {
+		return 0;
+	}
+	if (level > supported_simd_level())
+		level = supported_simd_level();
+
+	//The upper bits of a mask must fit in a positive int32_t
+	const int low_bits = (level == SimdLevel::AVX512) ? 4 : 3;
+	if (n <= low_bits || n - low_bits > 31) {
+		return exhaustive_gray_mask(foods, total_kcal);
+	}
+
+	SubsetBest best;
+	const int32_t* kcal = foods.kcal_data();
+	const int32_t* protein_g = foods.protein_g_data();
+	switch (level) {
+#ifdef MAXPROTEIN_X86_SIMD
+	case SimdLevel::AVX512:
+		exhaustive_kernel_avx512(kcal, protein_g, n, total_kcal, best);
+		break;
+	case SimdLevel::AVX2:
+		exhaustive_kernel_avx2(kcal, protein_g, n, total_kcal, best);
+		break;
+#endif
+	default:
+		exhaustive_kernel_scalar<8, 3>(kcal, protein_g, n, total_kcal, best);
+		break;
+	}
+	return best.mask;
+}
+
+IndexVector exhaustive_max_protein_simd(const FoodTable& foods,
+	int total_kcal,
+	SimdLevel level = supported_simd_level()) {
+	return mask_to_indices(exhaustive_simd_mask(foods, total_kcal, level));
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_protein_simd(const FoodVector& foods,
+	int total_kcal,
+	SimdLevel level = supported_simd_level()) {
+	return select_foods(foods,
+		exhaustive_max_protein_simd(FoodTable::numbers(foods), total_kcal, level));
+}
+
+// Compute the same result as exhaustive_max_protein for a table of
+// exactly N foods, with N fixed at compile time. The foods are copied
+// into std::arrays of size N, the mask type is the narrowest unsigned
+// type that holds N bits, and the subsets of the lowest LOW_BITS foods
+// are precomputed, so the inner loop over them has a constant trip
+// count the compiler unrolls completely. The upper bits are visited in
+// Gray-code order, as in exhaustive_max_protein_gray.
+template <int N>
+IndexVector exhaustive_max_protein_fixed(const FoodTable& foods, int total_kcal) {
+	static_assert(N >= 1 && N < 64, "exhaustive_max_protein_fixed needs 1 <= N < 64");
+	typedef typename std::conditional<(N <= 32), uint32_t, uint64_t>::type Mask;
+	const int LOW_BITS = (N < 4) ? N : 4;
+	const int LANES = 1 << LOW_BITS;
+
+	assert(foods.size() == size_t(N));
+	if (total_kcal < 0) {
+		return IndexVector();
+	}
+
+	std::array<int32_t, N> kcal, protein_g;
+	std::copy(foods.kcal_data(), foods.kcal_data() + N, kcal.begin());
+	std::copy(foods.protein_g_data(), foods.protein_g_data() + N, protein_g.begin());
+
+	std::array<int32_t, LANES> lane_kcal, lane_protein_g;
+	for (int lane = 0; lane < LANES; lane++) {
+		lane_kcal[lane] = lane_protein_g[lane] = 0;
+		for (int j = 0; j < LOW_BITS; j++) {
+			if ((lane >> j) & 1) {
+				lane_kcal[lane] += kcal[j];
+				lane_protein_g[lane] += protein_g[j];
+			}
+		}
+	}
+
+	SubsetBest best;
+	Mask high = 0;
+	int32_t high_kcal = 0, high_protein_g = 0;
+	const uint64_t end = uint64_t(1) << (N - LOW_BITS);
+	for (uint64_t k = 0; k < end; k++) {
+		if (k != 0) {
+			const int j = lowest_set_bit(k);
+			high ^= Mask(1) << j;
+			if ((high >> j) & 1) {
+				high_kcal += kcal[LOW_BITS + j];
+				high_protein_g += protein_g[LOW_BITS + j];
+			}
+			else {
+				high_kcal -= kcal[LOW_BITS + j];
+				high_protein_g -= protein_g[LOW_BITS + j];
+			}
+		}
+		for (int lane = 0; lane < LANES; lane++) {
+			const Mask mask = Mask(high << LOW_BITS) | Mask(lane);
+			if (mask != 0 && high_kcal + lane_kcal[lane] <= total_kcal)
+				best.consider(mask, high_protein_g + lane_protein_g[lane]);
+		}
+	}
+	return mask_to_indices(best.mask);
+}
+
+// Largest table size with a specialized exhaustive_max_protein_fixed
+// kernel in the dispatch table.
+const int EXHAUSTIVE_FIXED_MAX_N = 24;
+
+typedef IndexVector (*ExhaustiveFixedKernel)(const FoodTable&, int);
+
+// Compute the same result as exhaustive_max_protein, dispatching on the
+// size of foods to exhaustive_max_protein_fixed<N> through a constant
+// table. Tables larger than EXHAUSTIVE_FIXED_MAX_N use
+// exhaustive_max_protein_gray. The size of the table must be less than
+// 64.
+IndexVector exhaustive_max_protein_fixed(const FoodTable& foods, int total_kcal) {
+	static constexpr ExhaustiveFixedKernel kernels[EXHAUSTIVE_FIXED_MAX_N + 1] = {
+		nullptr,
+		exhaustive_max_protein_fixed<1>, exhaustive_max_protein_fixed<2>,
+		exhaustive_max_protein_fixed<3>, exhaustive_max_protein_fixed<4>,
+		exhaustive_max_protein_fixed<5>, exhaustive_max_protein_fixed<6>,
+		exhaustive_max_protein_fixed<7>, exhaustive_max_protein_fixed<8>,
+		exhaustive_max_protein_fixed<9>, exhaustive_max_protein_fixed<10>,
+		exhaustive_max_protein_fixed<11>, exhaustive_max_protein_fixed<12>,
+		exhaustive_max_protein_fixed<13>, exhaustive_max_protein_fixed<14>,
+		exhaustive_max_protein_fixed<15>, exhaustive_max_protein_fixed<16>,
+		exhaustive_max_protein_fixed<17>, exhaustive_max_protein_fixed<18>,
+		exhaustive_max_protein_fixed<19>, exhaustive_max_protein_fixed<20>,
+		exhaustive_max_protein_fixed<21>, exhaustive_max_protein_fixed<22>,
+		exhaustive_max_protein_fixed<23>, exhaustive_max_protein_fixed<24>
+	};
+
+	const size_t n = foods.size();
+	if (n == 0 || total_kcal < 0) {
+		return IndexVector();
+	}
+	if (n > size_t(EXHAUSTIVE_FIXED_MAX_N)) {
+		return exhaustive_max_protein_gray(foods, total_kcal);
+	}
+	return kernels[n](foods, total_kcal);
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_protein_fixed(const FoodVector& foods,
+	int total_kcal) {
+	return select_foods(foods, exhaustive_max_protein_fixed(FoodTable::numbers(foods), total_kcal));
+}
+
+// One subset of half of the foods in a meet-in-the-middle search.
+struct HalfSubset {
+	int kcal;
+	int protein_g;
+	uint64_t mask;
+};
+
+// Build the Pareto frontier of the subsets of foods [first, last) that
+// fit within total_kcal: the subsets for which no other subset has
+// fewer or equal kcal and at least as much protein. The frontier is
+// returned sorted by kcal, so its protein is strictly increasing too.
+// It is built one food at a time by merging the current frontier with
+// a copy that includes the new food, and pruning while merging; a
+// subset dominated now stays dominated once more foods are added, so
+// nothing useful is lost. Each step is linear, and the frontier never
+// has more than min(2^(last-first), total_kcal+1) entries.
+std::vector<HalfSubset> half_subset_frontier(const int32_t* kcal,
+	const int32_t* protein_g,
+	int first,
+	int last,
+	int total_kcal) {
+	std::vector<HalfSubset> frontier, with_food, merged;
+	HalfSubset empty = { 0, 0, 0 };
+	frontier.push_back(empty);
+
+	for (int j = first; j < last; j++) {
+		with_food.clear();
+		for (auto& subset : frontier) {
+			if (subset.kcal + kcal[j] <= total_kcal) {
+				HalfSubset extended = { subset.kcal + kcal[j],
+					subset.protein_g + protein_g[j],
+					subset.mask | (uint64_t(1) << j) };
+				with_food.push_back(extended);
+			}
+		}
+
+		merged.clear();
+		auto a = frontier.begin(), b = with_food.begin();
+		while (a != frontier.end() || b != with_food.end()) {
+			const bool take_a = (b == with_food.end()) ||
+				(a != frontier.end() &&
+				(a->kcal < b->kcal ||
+				(a->kcal == b->kcal && a->protein_g >= b->protein_g)));
+			const HalfSubset& next = take_a ? *a++ : *b++;
+			if (merged.empty() || next.protein_g > merged.back().protein_g)
+				merged.push_back(next);
+		}
+		frontier.swap(merged);
+	}
+	return frontier;
+}
+
+// Compute the optimal set of foods by meeting in the middle. The foods
+// are split into two halves, and the Pareto frontier of each half's
+// subsets is built with half_subset_frontier. Since both frontiers
+// are sorted by kcal with strictly increasing protein, a single
+// two-pointer pass pairs every lower-half subset with the best
+// upper-half subset that fits the remaining budget. This takes
+// O(2^(n/2)) time and space in the worst case instead of O(2^n), and
+// unlike dynamic_max_protein its cost does not grow with total_kcal.
+// The result has the same total protein as exhaustive_max_protein.
+// The size of the table must be less than 64.
+IndexVector meet_in_middle_max_protein(const FoodTable& foods,
+	int total_kcal) {
+	const int n = foods.size();
+	assert(n < 64);
+	if (total_kcal < 0) {
+		return IndexVector();
+	}
+	const int32_t* kcal = foods.kcal_data();
+	const int32_t* protein_g = foods.protein_g_data();
+
+	auto low = half_subset_frontier(kcal, protein_g, 0, n / 2, total_kcal),
+		high = half_subset_frontier(kcal, protein_g, n / 2, n, total_kcal);
+
+	//As low subsets get more kcal, their best partner can only get fewer
+	SubsetBest best;
+	auto partner = high.end();
+	for (auto& subset : low) {
+		while (partner != high.begin() &&
+			(partner == high.end() || subset.kcal + partner->kcal > total_kcal))
+			--partner;
+		//high[0] is the empty subset, which always fits
+		const uint64_t combined = subset.mask | partner->mask;
+		if (combined != 0)
+			best.consider(combined, subset.protein_g + partner->protein_g);
+	}
+	return mask_to_indices(best.mask);
+}
+
+std::unique_ptr<FoodVector> meet_in_middle_max_protein(const FoodVector& foods,
+	int total_kcal) {
+	return select_foods(foods,
+		meet_in_middle_max_protein(FoodTable::numbers(foods), total_kcal));
+}
+
+// Compute a near-optimal set of foods with a fully polynomial-time
+// approximation scheme. The result has at least (1-epsilon) times the
+// optimal total protein, where epsilon must be positive; smaller
+// epsilon is more accurate but slower. Protein is scaled down by
+// K = epsilon*LB/n, where n is the number of foods that can be part of
+// a solution and LB is the protein of the BEST_OF_BOTH greedy
+// solution, and a dynamic program finds the fewest kcal that reach
+// each scaled protein total. Scaling loses less than K per food, so
+// less than epsilon*LB <= epsilon*OPT in total. The table has one
+// entry per scaled protein total up to the LP-relaxation bound, about
+// OPT/K, so the running time is O(n^2/epsilon) regardless of
+// total_kcal, which makes this cheaper than dynamic_max_protein for
+// large budgets. When K would be below 1 no scaling is needed and the
+// result is exact. The selected foods are returned in their original
+// order.
+IndexVector fptas_max_protein(const FoodTable& foods,
+	int total_kcal,
+	double epsilon) {
+	assert(epsilon > 0);
+	if (total_kcal < 0) {
+		return IndexVector();
+	}
+
+	//Foods that can be part of a solution, in density order
+	IndexVector usable;
+	usable_foods(foods, total_kcal, usable);
+	if (usable.empty()) {
+		return IndexVector();
+	}
+	std::stable_sort(usable.begin(), usable.end(), [&](int a, int b) {
+		return denser(foods.protein_g(a), foods.kcal(a),
+			foods.protein_g(b), foods.kcal(b));
+	});
+	const int n = usable.size();
+
+	int lower_bound = 0;
+	for (int i : greedy_max_protein(foods, total_kcal, GreedyStrategy::BEST_OF_BOTH))
+		lower_bound += foods.protein_g(i);
+	const double scale = std::max(1.0, epsilon * lower_bound / n);
+
+	//LP-relaxation bound on the optimal protein
+	double upper_bound = 0;
+	for (int i = 0, remaining = total_kcal; i < n; i++) {
+		const int kcal = foods.kcal(usable[i]), protein_g = foods.protein_g(usable[i]);
+		if (kcal <= remaining) {
+			remaining -= kcal;
+			upper_bound += protein_g;
+		}
+		else {
+			upper_bound += double(remaining) * protein_g / kcal;
+			break;
+		}
+	}
+	const int max_scaled = int(std::floor(upper_bound / scale));
+
+	std::vector<int> scaled(n);
+	for (int i = 0; i < n; i++)
+		scaled[i] = int(std::floor(foods.protein_g(usable[i]) / scale));
+
+	//fewest[q] is the fewest kcal with scaled protein of exactly q
+	const int unreachable = total_kcal + 1;
+	std::vector<int> fewest(max_scaled + 1, unreachable);
+	fewest[0] = 0;
+	const size_t row_words = max_scaled / 64 + 1;
+	std::vector<uint64_t> choices(n * row_words, 0);
+	for (int i = 0; i < n; i++) {
+		const int kcal = foods.kcal(usable[i]);
+		uint64_t* bits = &choices[i * row_words];
+		for (int q = max_scaled; q >= scaled[i] && scaled[i] > 0; q--) {
+			const int with_food = fewest[q - scaled[i]] + kcal;
+			if (with_food < fewest[q]) {
+				fewest[q] = with_food;
+				bits[q / 64] |= uint64_t(1) << (q % 64);
+			}
+		}
+	}
+
+	int q = max_scaled;
+	while (fewest[q] > total_kcal)
+		q--;
+	IndexVector chosen;
+	for (int i = n - 1; i >= 0; i--) {
+		if ((choices[i * row_words + q / 64] >> (q % 64)) & 1) {
+			chosen.push_back(usable[i]);
+			q -= scaled[i];
+		}
+	}
+	std::sort(chosen.begin(), chosen.end());
+	return chosen;
+}
+
+std::unique_ptr<FoodVector> fptas_max_protein(const FoodVector& foods,
+	int total_kcal,
+	double epsilon) {
+	return select_foods(foods,
+		fptas_max_protein(FoodTable::numbers(foods), total_kcal, epsilon));
+}
+
+// Return the index in foods of each element of subset, which should
+// hold pointers taken from foods, such as the result of one of the
+// solvers. Each index is used at most once, so a food that appears in
+// foods several times can be matched several times. Elements of subset
+// that do not appear in foods are skipped.
+IndexVector food_vector_indices(const FoodVector& foods,
+	const FoodVector& subset) {
+	std::unordered_map<const Food*, IndexVector> positions;
+	for (int i = int(foods.size()) - 1; i >= 0; i--)
+		positions[foods[i].get()].push_back(i);
+
+	IndexVector result;
+	for (auto& food : subset) {
+		auto found = positions.find(food.get());
+		if (found != positions.end() && !found->second.empty()) {
+			result.push_back(found->second.back());
+			found->second.pop_back();
+		}
+	}
+	return result;
+}
+
+// Called with the original indices, in ascending order, and the total
+// protein of each new best solution a search finds.
+typedef std::function<void(const IndexVector&, int)> IncumbentCallback;
+
+// Depth-first branch-and-bound search for the optimal set of foods.
+// Foods that can be part of a solution are sorted by protein per kcal,
+// best first, and each node of the search decides whether to take the
+// next food, trying to take it first. A node is pruned when its
+// LP-relaxation bound, the protein of filling the remaining budget
+// greedily by ratio plus a fraction of the first food that does not
+// fit, cannot beat the incumbent. Prefix sums over the sorted foods
+// let each bound be computed with one binary search.
+class BranchAndBound {
+private:
+	int _total_kcal;
+
+	// Original index of each usable food, in ratio order.
+	IndexVector _order;
+
+	// kcal and protein of each usable food, in ratio order.
+	std::vector<int> _kcal, _protein_g;
+
+	// _prefix_kcal[i] is the total kcal of the first i sorted foods;
+	// likewise for _prefix_protein_g.
+	std::vector<int64_t> _prefix_kcal, _prefix_protein_g;
+
+	// Decisions along the current path, and for the incumbent.
+	std::vector<char> _taken, _best_taken;
+	int _best_protein_g;
+
+	// Search limits, where zero means unlimited, and progress.
+	uint64_t _node_limit;
+	double _time_limit;
+	uint64_t _nodes;
+	bool _aborted;
+	Timer _timer;
+
+	// Told about every improvement to the incumbent, when set.
+	IncumbentCallback _on_improvement;
+
+	// Upper bound on the protein of any completion of a node at depth,
+	// with remaining kcal left and value protein so far.
+	int64_t bound(size_t depth, int remaining, int value) const {
+		const size_t n = _order.size();
+		//Last t such that foods [depth, t) all fit in remaining
+		size_t t = std::upper_bound(_prefix_kcal.begin() + depth,
+			_prefix_kcal.end(),
+			_prefix_kcal[depth] + remaining) - _prefix_kcal.begin() - 1;
+		int64_t result = value + _prefix_protein_g[t] - _prefix_protein_g[depth];
+		if (t < n) {
+			int64_t left = remaining - (_prefix_kcal[t] - _prefix_kcal[depth]);
+			result += left * _protein_g[t] / _kcal[t];
+		}
+		return result;
+	}
+
+	template <bool ENABLED>
+	void search(size_t depth, int remaining, int value, SolveStats<ENABLED>& stats) {
+		if (_aborted) {
+			return;
+		}
+		_nodes++;
+		stats.visit();
+		if ((_node_limit != 0 && _nodes > _node_limit) ||
+			(_time_limit > 0 && (_nodes % 1024) == 0 &&
+			_timer.elapsed() > _time_limit)) {
+			_aborted = true;
+			return;
+		}
+
+		if (value > _best_protein_g) {
+			_best_protein_g = value;
+			_best_taken = _taken;
+			if (_on_improvement)
+				_on_improvement(best(), _best_protein_g);
+		}
+		if (depth == _order.size()) {
+			return;
+		}
+		if (bound(depth, remaining, value) <= _best_protein_g) {
+			stats.prune();
+			return;
+		}
+
+		if (_kcal[depth] <= remaining) {
+			_taken[depth] = 1;
+			search(depth + 1, remaining - _kcal[depth], value + _protein_g[depth], stats);
+			_taken[depth] = 0;
+		}
+		search(depth + 1, remaining, value, stats);
+	}
+
+public:
+	BranchAndBound(const FoodTable& foods, int total_kcal)
+		: _total_kcal(total_kcal),
+		_best_protein_g(0),
+		_node_limit(0),
+		_time_limit(0),
+		_nodes(0),
+		_aborted(false) {
+
+		usable_foods(foods, total_kcal, _order);
+		std::sort(_order.begin(), _order.end(), [&](int a, int b) {
+			if (denser(foods.protein_g(a), foods.kcal(a),
+				foods.protein_g(b), foods.kcal(b)))
+				return true;
+			if (denser(foods.protein_g(b), foods.kcal(b),
+				foods.protein_g(a), foods.kcal(a)))
+				return false;
+			if (foods.protein_g(a) != foods.protein_g(b))
+				return foods.protein_g(a) > foods.protein_g(b);
+			return a < b;
+		});
+
+		const size_t n = _order.size();
+		_kcal.resize(n);
+		_protein_g.resize(n);
+		_prefix_kcal.assign(n + 1, 0);
+		_prefix_protein_g.assign(n + 1, 0);
+		for (size_t i = 0; i < n; i++) {
+			_kcal[i] = foods.kcal(_order[i]);
+			_protein_g[i] = foods.protein_g(_order[i]);
+			_prefix_kcal[i + 1] = _prefix_kcal[i] + _kcal[i];
+			_prefix_protein_g[i + 1] = _prefix_protein_g[i] + _protein_g[i];
+		}
+		_taken.assign(n, 0);
+		_best_taken.assign(n, 0);
+	}
+
+	// Make the foods at the given original indices the incumbent, if
+	// they fit the budget and beat the current incumbent. Indices of
+	// foods that cannot be part of a solution are ignored.
+	void seed(const IndexVector& selection) {
+		std::vector<int> position_of(_order.empty() ? 0 :
+			*std::max_element(_order.begin(), _order.end()) + 1, -1);
+		for (size_t i = 0; i < _order.size(); i++)
+			position_of[_order[i]] = i;
+
+		std::vector<char> taken(_order.size(), 0);
+		int64_t kcal = 0, protein_g = 0;
+		for (int index : selection) {
+			if (index >= 0 && index < int(position_of.size()) &&
+				position_of[index] >= 0 && !taken[position_of[index]]) {
+				taken[position_of[index]] = 1;
+				kcal += _kcal[position_of[index]];
+				protein_g += _protein_g[position_of[index]];
+			}
+		}
+		if (kcal <= _total_kcal && protein_g > _best_protein_g) {
+			_best_protein_g = protein_g;
+			_best_taken = taken;
+			if (_on_improvement)
+				_on_improvement(best(), _best_protein_g);
+		}
+	}
+
+	// Call on_improvement whenever seed or run improves the incumbent.
+	void on_improvement(IncumbentCallback callback) {
+		_on_improvement = callback;
+	}
+
+	// Search until the incumbent is proven optimal, node_limit nodes
+	// have been visited, or time_limit seconds have passed, where zero
+	// means no limit. Returns true when the incumbent is proven optimal.
+	bool run(uint64_t node_limit = 0, double time_limit = 0) {
+		NullStats stats;
+		return run(stats, node_limit, time_limit);
+	}
+
+	// Like run(node_limit, time_limit), also counting the nodes visited
+	// and pruned in stats.
+	template <bool ENABLED>
+	bool run(SolveStats<ENABLED>& stats, uint64_t node_limit = 0, double time_limit = 0) {
+		_node_limit = node_limit;
+		_time_limit = time_limit;
+		_nodes = 0;
+		_aborted = false;
+		_timer.reset();
+		if (_total_kcal >= 0)
+			search(0, _total_kcal, 0, stats);
+		return !_aborted;
+	}
+
+	// Original indices of the incumbent foods, in ascending order.
+	IndexVector best() const {
+		IndexVector result;
+		for (size_t i = 0; i < _order.size(); i++) {
+			if (_best_taken[i])
+				result.push_back(_order[i]);
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	int best_protein_g() const { return _best_protein_g; }
+	uint64_t nodes() const { return _nodes; }
+};
+
+// Compute the optimal set of foods with branch and bound, seeded with
+// the greedy_max_protein result. Most branches on real USDA data are
+// pruned early, so this is practical for hundreds or thousands of
+// foods. The search stops after node_limit nodes or time_limit seconds,
+// where zero means no limit; proven_optimal tells whether it finished,
+// so the returned foods are optimal, or was cut short, so they are the
+// best found so far. The selected foods are returned in their original
+// order. The overload taking stats also records the nodes visited and
+// pruned, the solve time, and the gap to the LP bound.
+template <bool ENABLED>
+IndexVector branch_and_bound_max_protein(const FoodTable& foods,
+	int total_kcal,
+	bool& proven_optimal,
+	SolveStats<ENABLED>& stats,
+	uint64_t node_limit = 0,
+	double time_limit = 0) {
+	stats.begin_phase();
+	if (total_kcal < 0) {
+		proven_optimal = true;
+		stats.end_phase(StatsPhase::SOLVE);
+		return IndexVector();
+	}
+
+	BranchAndBound search(foods, total_kcal);
+	search.seed(greedy_max_protein(foods, total_kcal));
+	proven_optimal = search.run(stats, node_limit, time_limit);
+	IndexVector result = search.best();
+	stats.end_phase(StatsPhase::SOLVE);
+	finish_stats(stats, foods, total_kcal, result);
+	return result;
+}
+
+IndexVector branch_and_bound_max_protein(const FoodTable& foods,
+	int total_kcal,
+	bool& proven_optimal,
+	uint64_t node_limit = 0,
+	double time_limit = 0) {
+	NullStats stats;
+	return branch_and_bound_max_protein(foods, total_kcal, proven_optimal, stats,
+		node_limit, time_limit);
+}
+
+std::unique_ptr<FoodVector> branch_and_bound_max_protein(const FoodVector& foods,
+	int total_kcal,
+	bool& proven_optimal,
+	uint64_t node_limit = 0,
+	double time_limit = 0) {
+	return select_foods(foods, branch_and_bound_max_protein(FoodTable::numbers(foods),
+		total_kcal, proven_optimal, node_limit, time_limit));
+}
+
+// Compute the optimal set of foods with branch and bound, with no
+// limit on the search.
+IndexVector branch_and_bound_max_protein(const FoodTable& foods,
+	int total_kcal) {
+	bool proven_optimal;
+	return branch_and_bound_max_protein(foods, total_kcal, proven_optimal);
+}
+
+std::unique_ptr<FoodVector> branch_and_bound_max_protein(const FoodVector& foods,
+	int total_kcal) {
+	bool proven_optimal;
+	return branch_and_bound_max_protein(foods, total_kcal, proven_optimal);
+}
+
+// Compute the best set of foods found within time_budget, for callers
+// with a hard deadline. The greedy answer, the better of the PROTEIN
+// and BEST_OF_BOTH strategies, is available at once; branch and bound
+// then improves on it until it proves the incumbent optimal, the
+// deadline passes, or node_limit nodes have been visited, where zero
+// means no limit. Each new incumbent, starting with the greedy one, is
+// passed to on_improvement if it is set, so callers can act on partial
+// results, and proven_optimal tells whether the search finished. The
+// deadline is checked with Timer every 1024 nodes, so it may be
+// overrun by the time those nodes take, microseconds on USDA data. The
+// selected foods are returned in their original order.
+template <typename Rep, typename Period>
+IndexVector anytime_max_protein(const FoodTable& foods,
+	int total_kcal,
+	std::chrono::duration<Rep, Period> time_budget,
+	bool& proven_optimal,
+	IncumbentCallback on_improvement = IncumbentCallback(),
+	uint64_t node_limit = 0) {
+	Timer timer;
+	const double seconds =
+		std::chrono::duration_cast<std::chrono::duration<double>>(time_budget).count();
+	if (total_kcal < 0) {
+		proven_optimal = true;
+		return IndexVector();
+	}
+
+	BranchAndBound search(foods, total_kcal);
+	search.on_improvement(on_improvement);
+	search.seed(greedy_max_protein(foods, total_kcal, GreedyStrategy::BEST_OF_BOTH));
+	search.seed(greedy_max_protein(foods, total_kcal, GreedyStrategy::PROTEIN));
+
+	//run treats a time limit of zero as no limit at all
+	const double remaining = seconds - timer.elapsed();
+	proven_optimal = false;
+	if (remaining > 0)
+		proven_optimal = search.run(node_limit, remaining);
+	return search.best();
+}
+
+template <typename Rep, typename Period>
+std::unique_ptr<FoodVector> anytime_max_protein(const FoodVector& foods,
+	int total_kcal,
+	std::chrono::duration<Rep, Period> time_budget,
+	bool& proven_optimal,
+	IncumbentCallback on_improvement = IncumbentCallback(),
+	uint64_t node_limit = 0) {
+	return select_foods(foods, anytime_max_protein(FoodTable::numbers(foods),
+		total_kcal,
+		time_budget,
+		proven_optimal,
+		on_improvement,
+		node_limit));
+}
+
+// Table for the 0/1 knapsack dynamic program over kilocalories. Items
+// are added one at a time. After each addition, the rolling row holds,
+// for every budget w from 0 to capacity, the greatest total protein of
+// any subset of the items added so far whose kilocalories are at most
+// w. Alongside the row, the table keeps one bit per (item, budget)
+// pair recording whether adding that item improved the row at that
+// budget. Those bits are enough to reconstruct a selection for any
+// budget up to capacity, and cost n*(capacity+1)/8 bytes.
+class KnapsackTable {
+private:
+	// Largest budget the table can answer; must be non-negative.
+	int _capacity;
+
+	// Number of 64-bit words in one row of choice bits.
+	size_t _row_words;
+
+	// kcal of each item, in the order the items were added.
+	std::vector<int> _kcal;
+
+	// Rolling row; _best[w] is the greatest protein within budget w.
+	std::vector<int> _best;
+
+	// Choice bits, _row_words words per item.
+	std::vector<uint64_t> _choices;
+
+public:
+	explicit KnapsackTable(int capacity)
+		: _capacity(capacity),
+		_row_words(capacity / 64 + 1),
+		_best(capacity + 1, 0) {
+
+		assert(capacity >= 0);
+	}
+
+	int capacity() const { return _capacity; }
+	size_t size() const { return _kcal.size(); }
+
+	// Greatest total protein of the items added so far, within budget.
+	int max_protein(int budget) const {
+		assert((budget >= 0) && (budget <= _capacity));
+		return _best[budget];
+	}
+
+	// Whether item was taken when the row was updated at budget.
+	bool taken(size_t item, int budget) const {
+		assert(item < _kcal.size());
+		assert((budget >= 0) && (budget <= _capacity));
+		return (_choices[item * _row_words + budget / 64] >> (budget % 64)) & 1;
+	}
+
+	// Preallocate choice bits for a total of items items.
+	void reserve(size_t items) {
+		_kcal.reserve(items);
+		_choices.reserve(items * _row_words);
+	}
+
+	// Add one item and update the row in O(capacity) time.
+	void add(int kcal, int protein_g) {
+		assert(kcal >= 0);
+		assert(protein_g >= 0);
+
+		const size_t item = _kcal.size();
+		_kcal.push_back(kcal);
+		_choices.resize(_choices.size() + _row_words, 0);
+		uint64_t* bits = &_choices[item * _row_words];
+
+		// Walk budgets downward so each item is counted at most once.
+		for (int w = _capacity; w >= kcal; w--) {
+			int with_item = _best[w - kcal] + protein_g;
+			if (with_item > _best[w]) {
+				_best[w] = with_item;
+				bits[w / 64] |= uint64_t(1) << (w % 64);
+			}
+		}
+	}
+
+	// The rolling row: entry w is max_protein(w).
+	const std::vector<int>& row() const { return _best; }
+
+	// Remove every item after the first items, and restore the row,
+	// which must be a copy of row() from when the table held exactly
+	// those items.
+	void truncate(size_t items, const std::vector<int>& row) {
+		assert(items <= _kcal.size());
+		assert(row.size() == _best.size());
+		_kcal.resize(items);
+		_choices.resize(items * _row_words);
+		_best = row;
+	}
+
+	// Remove every item and change the capacity, keeping the storage
+	// the table has already allocated.
+	void reset(int capacity) {
+		assert(capacity >= 0);
+		_capacity = capacity;
+		_row_words = capacity / 64 + 1;
+		_kcal.clear();
+		_choices.clear();
+		_best.assign(capacity + 1, 0);
+	}
+
+	// Return the indices, in the order they were added, of a subset of
+	// the items achieving max_protein(budget) within budget.
+	IndexVector reconstruct(int budget) const {
+		IndexVector result;
+		reconstruct(budget, result);
+		return result;
+	}
+
+	// Like reconstruct(budget), but replace the contents of result.
+	void reconstruct(int budget, IndexVector& result) const {
+		assert((budget >= 0) && (budget <= _capacity));
+		result.clear();
+		int w = budget;
+		for (size_t item = _kcal.size(); item-- > 0; ) {
+			if (taken(item, w)) {
+				result.push_back(item);
+				w -= _kcal[item];
+			}
+		}
+		std::reverse(result.begin(), result.end());
+	}
+};
+
+// Replace rows with usable_foods(foods, capacity) and rebuild table
+// for capacity with one item per food of rows, in order, recording the
+// DP cells updated in stats.
+template <bool ENABLED>
+void build_knapsack_table(const FoodTable& foods,
+	int capacity,
+	IndexVector& rows,
+	KnapsackTable& table,
+	SolveStats<ENABLED>& stats) {
+	usable_foods(foods, capacity, rows);
+	table.reset(capacity);
+	table.reserve(rows.size());
+	for (int i : rows) {
+		table.add(foods.kcal(i), foods.protein_g(i));
+		stats.touch_cells(capacity - foods.kcal(i) + 1);
+	}
+}
+
+void build_knapsack_table(const FoodTable& foods,
+	int capacity,
+	IndexVector& rows,
+	KnapsackTable& table) {
+	NullStats stats;
+	build_knapsack_table(foods, capacity, rows, table, stats);
+}
+
+// Replace result with an optimal selection within budget from a table
+// made by build_knapsack_table with rows, as indices into its foods in
+// ascending order.
+void reconstruct_foods(const KnapsackTable& table,
+	const IndexVector& rows,
+	int budget,
+	IndexVector& result) {
+	table.reconstruct(budget, result);
+	for (int& row : result)
+		row = rows[row];
+}
+
+// Reusable scratch storage for the solver overloads that write their
+// answer into a caller-provided buffer. Every buffer grows to fit the
+// largest problem it has seen and is then reused, so after a warm-up
+// solve of the same size and budget, those overloads perform no heap
+// allocation at all. A workspace must not be shared between threads.
+class SolverWorkspace {
+public:
+	// Food indices: greedy order, or foods with a row in the DP table.
+	IndexVector order;
+
+	// The answer, before it is copied out.
+	IndexVector selection;
+
+	// DP rows and choice bits.
+	KnapsackTable table;
+
+	SolverWorkspace() : table(0) { }
+};
+
+// Copy as many of indices as fit into out, which has room for
+// capacity indices, and return the total number of indices, which may
+// be greater than capacity, like snprintf.
+size_t copy_indices(const IndexVector& indices, int* out, size_t capacity) {
+	assert(out != nullptr || capacity == 0);
+	std::copy(indices.begin(),
+		indices.begin() + std::min(capacity, indices.size()),
+		out);
+	return indices.size();
+}
+
+// Compute the optimal set of foods with dynamic programming, treating
+// the problem as a 0/1 knapsack over kilocalories. The result has the
+// same total protein as exhaustive_max_protein, but takes
+// O(n*total_kcal) time instead of O(2^n), so it can handle the entire
+// USDA database. Foods without protein, or with more kilocalories than
+// the whole budget, can never improve a solution, so they are left out
+// of the table. The selected foods are returned in their original
+// order. The overloads taking stats also record the DP cells updated,
+// the scratch memory, and the solve time. The overloads taking a
+// workspace use its buffers, write the chosen indices to out, and
+// return how many there are; see copy_indices.
+template <bool ENABLED>
+size_t dynamic_max_protein(const FoodTable& foods,
+	int total_kcal,
+	SolverWorkspace& workspace,
+	int* out,
+	size_t capacity,
+	SolveStats<ENABLED>& stats) {
+	stats.begin_phase();
+	workspace.selection.clear();
+	if (total_kcal >= 0) {
+		//Original index of each food that gets a row in the table
+		const IndexVector& rows = workspace.order;
+		build_knapsack_table(foods, total_kcal, workspace.order, workspace.table, stats);
+		const size_t scratch_bytes = rows.capacity() * sizeof(int) +
+			(size_t(total_kcal) + 1 + rows.size()) * sizeof(int) +
+			rows.size() * (size_t(total_kcal) / 64 + 1) * sizeof(uint64_t);
+		stats.allocate(scratch_bytes);
+		reconstruct_foods(workspace.table, rows, total_kcal, workspace.selection);
+		stats.release(scratch_bytes);
+	}
+	stats.end_phase(StatsPhase::SOLVE);
+	finish_stats(stats, foods, total_kcal, workspace.selection);
+	return copy_indices(workspace.selection, out, capacity);
+}
+
+size_t dynamic_max_protein(const FoodTable& foods,
+	int total_kcal,
+	SolverWorkspace& workspace,
+	int* out,
+	size_t capacity) {
+	NullStats stats;
+	return dynamic_max_protein(foods, total_kcal, workspace, out, capacity, stats);
+}
+
+template <bool ENABLED>
+IndexVector dynamic_max_protein(const FoodTable& foods,
+	int total_kcal,
+	SolveStats<ENABLED>& stats) {
+	SolverWorkspace workspace;
+	dynamic_max_protein(foods, total_kcal, workspace, nullptr, 0, stats);
+	return std::move(workspace.selection);
+}
+
+IndexVector dynamic_max_protein(const FoodTable& foods,
+	int total_kcal) {
+	NullStats stats;
+	return dynamic_max_protein(foods, total_kcal, stats);
+}
+
+std::unique_ptr<FoodVector> dynamic_max_protein(const FoodVector& foods,
+	int total_kcal) {
+	return select_foods(foods, dynamic_max_protein(FoodTable::numbers(foods), total_kcal));
+}
+
+// Set best[w], for w from 0 to total_kcal, to the greatest protein of
+// any subset of foods rows[begin, end) within w kilocalories.
+void knapsack_row(const FoodTable& foods,
+	const IndexVector& rows,
+	size_t begin,
+	size_t end,
+	int total_kcal,
+	std::vector<int>& best) {
+	best.assign(total_kcal + 1, 0);
+	for (size_t r = begin; r < end; r++) {
+		const int kcal = foods.kcal(rows[r]), protein_g = foods.protein_g(rows[r]);
+		for (int w = total_kcal; w >= kcal; w--)
+			best[w] = std::max(best[w], best[w - kcal] + protein_g);
+	}
+}
+
+// Largest subproblem, in 64-bit words of choice bits, that
+// dynamic_max_protein_low_memory solves with a KnapsackTable.
+const size_t LOW_MEMORY_TABLE_WORDS = 4096;
+
+// Append to result an optimal subset of foods rows[begin, end) within
+// total_kcal, by divide and conquer.
+template <bool ENABLED>
+void low_memory_knapsack(const FoodTable& foods,
+	const IndexVector& rows,
+	size_t begin,
+	size_t end,
+	int total_kcal,
+	IndexVector& result,
+	SolveStats<ENABLED>& stats) {
+	const size_t items = end - begin;
+	if (items == 0) {
+		return;
+	}
+	//One food needs no table, and splitting it would never shrink the
+	//subproblem when a single row of choice bits is over the limit
+	if (items == 1) {
+		if (foods.kcal(rows[begin]) <= total_kcal)
+			result.push_back(rows[begin]);
+		return;
+	}
+	const size_t row_words = size_t(total_kcal) / 64 + 1;
+	if (items * row_words <= LOW_MEMORY_TABLE_WORDS) {
+		const size_t bytes = items * row_words * sizeof(uint64_t) +
+			(size_t(total_kcal) + 1) * sizeof(int);
+		stats.allocate(bytes);
+		KnapsackTable table(total_kcal);
+		table.reserve(items);
+		for (size_t r = begin; r < end; r++) {
+			const int kcal = foods.kcal(rows[r]);
+			table.add(kcal, foods.protein_g(rows[r]));
+			//Foods over this share of the budget update no cells
+			if (kcal <= total_kcal)
+				stats.touch_cells(total_kcal - kcal + 1);
+		}
+		for (int item : table.reconstruct(total_kcal))
+			result.push_back(rows[begin + item]);
+		stats.release(bytes);
+		return;
+	}
+
+	//Split the budget where the best of both halves adds up to the most;
+	//the rows are freed before recursing, so only O(total_kcal) is live
+	const size_t mid = begin + items / 2;
+	int split = 0;
+	{
+		const size_t bytes = 2 * (size_t(total_kcal) + 1) * sizeof(int);
+		stats.allocate(bytes);
+		std::vector<int> left, right;
+		knapsack_row(foods, rows, begin, mid, total_kcal, left);
+		knapsack_row(foods, rows, mid, end, total_kcal, right);
+		for (size_t r = begin; r < end; r++) {
+			if (foods.kcal(rows[r]) <= total_kcal)
+				stats.touch_cells(total_kcal - foods.kcal(rows[r]) + 1);
+		}
+		for (int w = 1; w <= total_kcal; w++) {
+			if (left[w] + right[total_kcal - w] > left[split] + right[total_kcal - split])
+				split = w;
+		}
+		stats.release(bytes);
+	}
+	low_memory_knapsack(foods, rows, begin, mid, split, result, stats);
+	low_memory_knapsack(foods, rows, mid, end, total_kcal - split, result, stats);
+}
+
+// Compute the same total protein as dynamic_max_protein, but in
+// O(total_kcal) memory instead of a choice bit per (food, budget)
+// pair. Hirschberg-style, the foods are split in half, one DP row for
+// each half finds how the budget divides between them in an optimal
+// solution, and each half is solved recursively with its share, down
+// to subproblems small enough for a KnapsackTable of at most
+// LOW_MEMORY_TABLE_WORDS words. This takes about twice the time of
+// dynamic_max_protein. The selected foods are returned in their
+// original order. The overload taking stats also records the DP cells
+// updated, the peak scratch memory, and the solve time.
+template <bool ENABLED>
+IndexVector dynamic_max_protein_low_memory(const FoodTable& foods,
+	int total_kcal,
+	SolveStats<ENABLED>& stats) {
+	stats.begin_phase();
+	IndexVector result;
+	if (total_kcal >= 0) {
+		IndexVector rows;
+		usable_foods(foods, total_kcal, rows);
+		stats.allocate(rows.capacity() * sizeof(int));
+		low_memory_knapsack(foods, rows, 0, rows.size(), total_kcal, result, stats);
+		stats.release(rows.capacity() * sizeof(int));
+		std::sort(result.begin(), result.end());
+	}
+	stats.end_phase(StatsPhase::SOLVE);
+	finish_stats(stats, foods, total_kcal, result);
+	return result;
+}
+
+IndexVector dynamic_max_protein_low_memory(const FoodTable& foods,
+	int total_kcal) {
+	NullStats stats;
+	return dynamic_max_protein_low_memory(foods, total_kcal, stats);
+}
+
+std::unique_ptr<FoodVector> dynamic_max_protein_low_memory(const FoodVector& foods,
+	int total_kcal) {
+	return select_foods(foods, dynamic_max_protein_low_memory(FoodTable::numbers(foods), total_kcal));
+}
+
+// Compute how many servings of each food, from 0 to max_servings[i],
+// give the most total protein within total_kcal: a bounded knapsack,
+// or an unbounded one for foods with UNLIMITED_SERVINGS. Each food's
+// servings, capped at what fits in the budget, are split into pieces
+// of 1, 2, 4, ... servings and a remainder, so every count up to the
+// cap is a sum of distinct pieces, and the pieces go through the usual
+// 0/1 KnapsackTable. That takes O(sum of log(servings) * total_kcal)
+// time: better than O(sum of servings * total_kcal) for one copy per
+// serving, but not the O(n * total_kcal) of a monotone-queue bounded
+// knapsack. Zero-kcal foods with protein are free, so every serving of
+// them is taken; if one of them has UNLIMITED_SERVINGS the total
+// protein is unbounded, and the result is empty. Otherwise returns the
+// number of servings of each food.
+std::vector<int> bounded_max_protein(const FoodTable& foods,
+	const std::vector<int>& max_servings,
+	int total_kcal) {
+	assert(max_servings.size() == foods.size());
+	std::vector<int> servings(foods.size(), 0);
+	if (total_kcal < 0) {
+		return servings;
+	}
+
+	//Food and serving count of each piece
+	IndexVector piece_food;
+	std::vector<int> piece_servings;
+	for (int i = 0; i < int(foods.size()); i++) {
+		const int kcal = foods.kcal(i);
+		int count = max_servings[i];
+		assert(count >= 0);
+		if (foods.protein_g(i) == 0 || kcal > total_kcal)
+			continue;
+		if (kcal > 0)
+			count = std::min(count, total_kcal / kcal);
+		if (kcal == 0) {
+			if (count == UNLIMITED_SERVINGS) {
+				return std::vector<int>();
+			}
+			servings[i] = count;
+			continue;
+		}
+		for (int piece = 1; count > 0; piece *= 2) {
+			const int size = std::min(piece, count);
+			piece_food.push_back(i);
+			piece_servings.push_back(size);
+			count -= size;
+		}
+	}
+
+	KnapsackTable table(total_kcal);
+	table.reserve(piece_food.size());
+	for (size_t p = 0; p < piece_food.size(); p++) {
+		table.add(piece_servings[p] * foods.kcal(piece_food[p]),
+			piece_servings[p] * foods.protein_g(piece_food[p]));
+	}
+	for (int p : table.reconstruct(total_kcal))
+		servings[piece_food[p]] += piece_servings[p];
+	return servings;
+}
+
+// Compute bounded_max_protein with each food's max_servings(), and
+// return the meal with each chosen food repeated once per serving, or
+// nullptr if the total protein is unbounded.
+std::unique_ptr<FoodVector> bounded_max_protein(const FoodVector& foods,
+	int total_kcal) {
+	std::vector<int> max_servings;
+	for (const auto& food : foods)
+		max_servings.push_back(food->max_servings());
+	const std::vector<int> servings =
+		bounded_max_protein(FoodTable::numbers(foods), max_servings, total_kcal);
+	if (servings.size() != foods.size()) {
+		return nullptr;
+	}
+
+	std::unique_ptr<FoodVector> result(new FoodVector);
+	for (size_t i = 0; i < foods.size(); i++)
+		result->insert(result->end(), servings[i], foods[i]);
+	return result;
+}
+
+// Dynamic programming over a set of foods that changes a few foods at
+// a time, as in an interactive editor, for one fixed budget. The
+// KnapsackTable is kept between changes, with a copy of its row saved
+// every checkpoint_interval rows. Adding a food updates the table in
+// O(total_kcal) time rather than the O(n*total_kcal) of a cold
+// dynamic_max_protein. Removing a food truncates the table to the
+// last checkpoint before that food's row and re-adds the rows after
+// it, so removing a recently added food is about as cheap, while
+// removing one of the first foods costs about as much as a cold solve.
+class IncrementalSolver {
+private:
+	int _total_kcal;
+	size_t _checkpoint_interval;
+
+	// Foods in the order they were added.
+	FoodVector _foods;
+
+	// Position in _foods of the food in each table row. Foods without
+	// protein, or with more kilocalories than the budget, get no row.
+	IndexVector _rows;
+
+	KnapsackTable _table;
+
+	// _checkpoints[k] is the table's row after k*_checkpoint_interval rows.
+	std::vector<std::vector<int>> _checkpoints;
+
+	// Rows recomputed by the last change.
+	size_t _rows_updated;
+
+	void add_row(int position) {
+		const Food& food = *_foods[position];
+		_rows.push_back(position);
+		_table.add(food.kcal(), food.protein_g());
+		if (_table.size() % _checkpoint_interval == 0)
+			_checkpoints.push_back(_table.row());
+		_rows_updated++;
+	}
+
+	void add_position(int position) {
+		const Food& food = *_foods[position];
+		if (food.protein_g() > 0 && food.kcal() <= _total_kcal)
+			add_row(position);
+	}
+
+public:
+	// Start with no foods. total_kcal must be non-negative.
+	explicit IncrementalSolver(int total_kcal, size_t checkpoint_interval = 64)
+		: _total_kcal(total_kcal),
+		_checkpoint_interval(checkpoint_interval),
+		_table(total_kcal),
+		_checkpoints(1, std::vector<int>(total_kcal + 1, 0)),
+		_rows_updated(0) {
+		assert(total_kcal >= 0);
+		assert(checkpoint_interval > 0);
+	}
+
+	IncrementalSolver(const FoodVector& foods,
+		int total_kcal,
+		size_t checkpoint_interval = 64)
+		: IncrementalSolver(total_kcal, checkpoint_interval) {
+		_table.reserve(foods.size());
+		for (const auto& food : foods)
+			add_food(food);
+		_rows_updated = _table.size();
+	}
+
+	int total_kcal() const { return _total_kcal; }
+	size_t size() const { return _foods.size(); }
+	const FoodVector& foods() const { return _foods; }
+
+	// Rows of the table recomputed by the last add_food or remove_food,
+	// or by the constructor; a cold solve recomputes every row.
+	size_t rows_updated() const { return _rows_updated; }
+
+	// Add food after the others, in O(total_kcal) time.
+	void add_food(std::shared_ptr<Food> food) {
+		assert(food);
+		_rows_updated = 0;
+		_foods.push_back(food);
+		add_position(_foods.size() - 1);
+	}
+
+	// Remove the food at position in foods(); later foods move down
+	// one position.
+	void remove_food(size_t position) {
+		assert(position < _foods.size());
+		_rows_updated = 0;
+		_foods.erase(_foods.begin() + position);
+
+		auto row = std::lower_bound(_rows.begin(), _rows.end(), int(position));
+		const bool had_row = (row != _rows.end() && *row == int(position));
+		const size_t first = row - _rows.begin();
+		//Rows of later foods keep their table contents; only renumber them
+		for (auto later = row; later != _rows.end(); ++later) {
+			if (*later > int(position))
+				--*later;
+		}
+		if (!had_row)
+			return;
+
+		const size_t checkpoint = first / _checkpoint_interval,
+			kept = checkpoint * _checkpoint_interval;
+		IndexVector replay(_rows.begin() + kept, _rows.end());
+		replay.erase(replay.begin() + (first - kept));
+		_rows.resize(kept);
+		_checkpoints.resize(checkpoint + 1);
+		_table.truncate(kept, _checkpoints[checkpoint]);
+		for (int later : replay)
+			add_row(later);
+	}
+
+	// Remove the last food added that is food itself, compared by
+	// pointer, and return whether there was one.
+	bool remove_food(const std::shared_ptr<Food>& food) {
+		for (size_t i = _foods.size(); i-- > 0; ) {
+			if (_foods[i] == food) {
+				remove_food(i);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Greatest total protein of the current foods within the budget.
+	int max_protein() const { return _table.max_protein(_total_kcal); }
+
+	// Positions in foods(), in order, of a set of foods achieving
+	// max_protein() within the budget.
+	IndexVector best() const {
+		IndexVector result;
+		for (int row : _table.reconstruct(_total_kcal))
+			result.push_back(_rows[row]);
+		return result;
+	}
+};
+
+// Compute dynamic_max_protein(foods, budget) for every budget in
+// budgets, in one call. A single KnapsackTable is built up to the
+// largest budget; its choice bits answer every smaller budget too, so
+// each additional budget only costs an O(n) reconstruction.
+std::vector<IndexVector> dynamic_max_protein_batch(const FoodTable& foods,
+	const std::vector<int>& budgets) {
+	std::vector<IndexVector> result(budgets.size());
+	if (budgets.empty()) {
+		return result;
+	}
+	const int capacity = *std::max_element(budgets.begin(), budgets.end());
+	if (capacity < 0) {
+		return result;
+	}
+
+	IndexVector rows;
+	KnapsackTable table(capacity);
+	build_knapsack_table(foods, capacity, rows, table);
+
+	for (size_t b = 0; b < budgets.size(); b++) {
+		if (budgets[b] >= 0)
+			reconstruct_foods(table, rows, budgets[b], result[b]);
+	}
+	return result;
+}
+
+std::vector<std::unique_ptr<FoodVector>> dynamic_max_protein_batch(const FoodVector& foods,
+	const std::vector<int>& budgets) {
+	std::vector<std::unique_ptr<FoodVector>> result;
+	for (auto& chosen : dynamic_max_protein_batch(FoodTable::numbers(foods), budgets))
+		result.push_back(select_foods(foods, chosen));
+	return result;
+}
+
+// Compute greedy_max_protein(foods, total_kcal, strategy) using the
+// buffers in workspace, write the chosen indices to out, and return
+// how many there are; see copy_indices.
+size_t greedy_max_protein(const FoodTable& foods,
+	int total_kcal,
+	SolverWorkspace& workspace,
+	int* out,
+	size_t capacity,
+	GreedyStrategy strategy = GreedyStrategy::PROTEIN) {
+	greedy_order(foods,
+		strategy == GreedyStrategy::BEST_OF_BOTH ? GreedyStrategy::DENSITY : strategy,
+		workspace.order);
+	greedy_fill(foods, workspace.order, total_kcal, workspace.selection);
+	if (strategy == GreedyStrategy::BEST_OF_BOTH)
+		best_of_both(foods, total_kcal, workspace.selection);
+	return copy_indices(workspace.selection, out, capacity);
+}
+
+// Compute exhaustive_max_protein_simd(foods, total_kcal), write the
+// chosen indices to out, and return how many there are; see
+// copy_indices. The search itself needs no scratch storage, so this
+// only uses workspace to hold the answer.
+size_t exhaustive_max_protein(const FoodTable& foods,
+	int total_kcal,
+	SolverWorkspace& workspace,
+	int* out,
+	size_t capacity) {
+	workspace.selection.clear();
+	const uint64_t mask = exhaustive_simd_mask(foods, total_kcal);
+	for (int i = 0; i < 64; i++) {
+		if ((mask >> i) & 1)
+			workspace.selection.push_back(i);
+	}
+	return copy_indices(workspace.selection, out, capacity);
+}
+
+// Memoizing front end for dynamic_max_protein. Queries are keyed by a
+// fingerprint of the multiset of (kcal, protein) pairs in the input,
+// so the same foods in any order, or from a different load, share one
+// entry. Each entry keeps the KnapsackTable from its solve, whose
+// choice bits can reconstruct the answer for any budget up to the one
+// it was built for, plus the selections already reconstructed. So a
+// repeated query costs an O(n) fingerprint pass, a hash lookup and an
+// O(n log n) comparison of the foods; a smaller budget on a known food
+// set costs one reconstruction instead of a new solve. A hit also
+// compares the entry's (kcal, protein) pairs with the query's, so a
+// fingerprint collision is treated as a miss and answers stay exact.
+// At most capacity entries are kept, evicting the least recently used,
+// and each keeps at most MAX_SELECTIONS reconstructed budgets.
+class MaxProteinCache {
+public:
+	static const size_t MAX_SELECTIONS = 16;
+
+private:
+	typedef std::pair<int, int> KcalProtein;
+
+	struct Entry {
+		uint64_t fingerprint;
+
+		// The food set's usable (kcal, protein) pairs, one per table row.
+		std::vector<KcalProtein> rows;
+
+		KnapsackTable table;
+
+		// Rows chosen for each budget reconstructed so far.
+		std::unordered_map<int, IndexVector> selections;
+
+		Entry(uint64_t fingerprint_, int capacity)
+			: fingerprint(fingerprint_), table(capacity) { }
+	};
+
+	size_t _capacity;
+	std::list<Entry> _entries;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> _by_fingerprint;
+	size_t _hits, _misses;
+
+	static uint64_t mix(uint64_t x) {
+		//splitmix64 finalizer
+		x += 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	// Order-independent hash of the (kcal, protein) multiset of foods.
+	static uint64_t fingerprint(const FoodTable& foods) {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < foods.size(); i++)
+			sum += mix((uint64_t(uint32_t(foods.kcal(i))) << 32) | uint32_t(foods.protein_g(i)));
+		return mix(sum ^ mix(foods.size()));
+	}
+
+	// Replace rows with the usable (kcal, protein) pairs of foods under
+	// capacity, in a canonical order that does not depend on the order
+	// of foods.
+	static void table_rows(const FoodTable& foods,
+		int capacity,
+		std::vector<KcalProtein>& rows) {
+		IndexVector usable;
+		usable_foods(foods, capacity, usable);
+		rows.clear();
+		for (int i : usable)
+			rows.push_back(KcalProtein(foods.kcal(i), foods.protein_g(i)));
+		std::sort(rows.begin(), rows.end());
+	}
+
+	// Solve foods from scratch into a new entry with the given capacity.
+	static void build(Entry& entry, const FoodTable& foods, int capacity) {
+		table_rows(foods, capacity, entry.rows);
+		entry.table.reserve(entry.rows.size());
+		for (auto& row : entry.rows)
+			entry.table.add(row.first, row.second);
+	}
+
+	// Map the rows chosen in entry back to foods, whose table rows must
+	// be entry's: for each chosen pair, the first food in foods with
+	// that kcal and protein not used yet.
+	static void assign(const Entry& entry,
+		const IndexVector& chosen,
+		const FoodTable& foods,
+		IndexVector& result) {
+		std::map<KcalProtein, int> needed;
+		for (int row : chosen)
+			needed[entry.rows[row]]++;
+		size_t remaining = chosen.size();
+		result.clear();
+		for (size_t i = 0; i < foods.size() && remaining > 0; i++) {
+			auto found = needed.find(KcalProtein(foods.kcal(i), foods.protein_g(i)));
+			if (found != needed.end() && found->second > 0) {
+				found->second--;
+				remaining--;
+				result.push_back(i);
+			}
+		}
+		assert(remaining == 0);
+		(void)remaining;
+	}
+
+public:
+	explicit MaxProteinCache(size_t capacity)
+		: _capacity(capacity),
+		_hits(0),
+		_misses(0) {
+
+		assert(capacity > 0);
+	}
+
+	// Return the same total protein as dynamic_max_protein(foods,
+	// total_kcal), as indices into foods in ascending order.
+	IndexVector solve(const FoodTable& foods, int total_kcal) {
+		if (total_kcal < 0) {
+			return IndexVector();
+		}
+
+		const uint64_t key = fingerprint(foods);
+		auto found = _by_fingerprint.find(key);
+		if (found != _by_fingerprint.end() &&
+			found->second->table.capacity() >= total_kcal) {
+			Entry& entry = *found->second;
+			std::vector<KcalProtein> rows;
+			table_rows(foods, entry.table.capacity(), rows);
+			if (rows == entry.rows) {
+				auto selection = entry.selections.find(total_kcal);
+				if (selection == entry.selections.end()) {
+					if (entry.selections.size() >= MAX_SELECTIONS)
+						entry.selections.clear();
+					selection = entry.selections.insert(std::make_pair(total_kcal,
+						entry.table.reconstruct(total_kcal))).first;
+				}
+				IndexVector result;
+				assign(entry, selection->second, foods, result);
+				_hits++;
+				_entries.splice(_entries.begin(), _entries, found->second);
+				return result;
+			}
+		}
+
+		//Miss: solve from scratch, replacing any entry built for a
+		//smaller budget
+		_misses++;
+		if (found != _by_fingerprint.end()) {
+			_entries.erase(found->second);
+			_by_fingerprint.erase(found);
+		}
+		_entries.push_front(Entry(key, total_kcal));
+		Entry& entry = _entries.front();
+		build(entry, foods, total_kcal);
+		_by_fingerprint[key] = _entries.begin();
+		while (_entries.size() > _capacity) {
+			_by_fingerprint.erase(_entries.back().fingerprint);
+			_entries.pop_back();
+		}
+
+		IndexVector chosen = entry.table.reconstruct(total_kcal), result;
+		entry.selections[total_kcal] = chosen;
+		assign(entry, chosen, foods, result);
+		return result;
+	}
+
+	std::unique_ptr<FoodVector> solve(const FoodVector& foods, int total_kcal) {
+		return select_foods(foods, solve(FoodTable::numbers(foods), total_kcal));
+	}
+
+	size_t size() const { return _entries.size(); }
+	size_t capacity() const { return _capacity; }
+	size_t hits() const { return _hits; }
+	size_t misses() const { return _misses; }
+
+	void clear() {
+		_entries.clear();
+		_by_fingerprint.clear();
+	}
+};
+
+// A smaller 0-1 problem with the same optimal protein total as a
+// FoodTable under one budget, and the way back to the original foods.
+//
+// Foods with no protein or more kcal than the budget are dropped, and
+// foods with identical (kcal, protein) pairs form one group of
+// interchangeable copies, of which only as many are kept as fit in the
+// budget. A group is also dropped when the copies of groups that
+// dominate it, i.e. have no more kcal and no less protein, number at
+// least the largest count of foods any feasible subset can hold: an
+// optimal subset can then always swap a dominated food for an unused
+// dominating one. The copies of each group are consecutive in foods(),
+// so any exact solver can run on foods() directly, or on the groups
+// as a bounded knapsack.
+class FoodReduction {
+private:
+	// Kept foods, grouped by (kcal, protein), numeric columns only.
+	FoodTable _foods;
+
+	// Group g spans _foods indices [_group_begin[g], _group_begin[g+1]).
+	std::vector<size_t> _group_begin;
+
+	// Index, in the original table, of each food in _foods.
+	IndexVector _original;
+
+	// Counts copies of groups below a protein rank, as a Fenwick tree.
+	class RankCounter {
+	private:
+		std::vector<size_t> _tree;
+	public:
+		explicit RankCounter(size_t ranks) : _tree(ranks + 1, 0) { }
+
+		void add(size_t rank, size_t count) {
+			for (size_t i = rank + 1; i < _tree.size(); i += i & (~i + 1))
+				_tree[i] += count;
+		}
+
+		// Total count of ranks [0, rank].
+		size_t prefix(size_t rank) const {
+			size_t total = 0;
+			for (size_t i = rank + 1; i > 0; i -= i & (~i + 1))
+				total += _tree[i];
+			return total;
+		}
+	};
+
+public:
+	FoodReduction(const FoodTable& foods, int total_kcal) : _group_begin(1, 0) {
+		if (total_kcal < 0)
+			return;
+
+		//Group the useful foods by (kcal, protein), in order of first occurrence
+		std::vector<IndexVector> members;
+		std::unordered_map<uint64_t, size_t> group_of;
+		for (size_t i = 0; i < foods.size(); i++) {
+			if (foods.protein_g(i) <= 0 || foods.kcal(i) > total_kcal)
+				continue;
+			const uint64_t key = (uint64_t(uint32_t(foods.kcal(i))) << 32) |
+				uint32_t(foods.protein_g(i));
+			auto found = group_of.insert(std::make_pair(key, members.size()));
+			if (found.second)
+				members.push_back(IndexVector());
+			members[found.first->second].push_back(i);
+		}
+
+		//No subset holds more than budget / kcal copies of one group
+		for (auto& group : members) {
+			const int kcal = foods.kcal(group.front());
+			if (kcal > 0 && group.size() > size_t(total_kcal / kcal))
+				group.resize(total_kcal / kcal);
+		}
+
+		//The most foods any feasible subset can hold: the cheapest ones
+		std::vector<int> all_kcal;
+		for (const auto& group : members)
+			all_kcal.insert(all_kcal.end(), group.size(), foods.kcal(group.front()));
+		std::sort(all_kcal.begin(), all_kcal.end());
+		size_t max_items = 0;
+		for (int kcal = 0; max_items < all_kcal.size() &&
+			kcal + all_kcal[max_items] <= total_kcal; max_items++) {
+			kcal += all_kcal[max_items];
+		}
+
+		//Visit groups by kcal, then by descending protein, so every
+		//dominating group is counted before the groups it dominates
+		std::vector<int> proteins;
+		for (const auto& group : members)
+			proteins.push_back(-foods.protein_g(group.front()));
+		std::sort(proteins.begin(), proteins.end());
+		proteins.erase(std::unique(proteins.begin(), proteins.end()), proteins.end());
+
+		IndexVector order(members.size());
+		for (size_t g = 0; g < order.size(); g++)
+			order[g] = g;
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+			const int kcal_a = foods.kcal(members[a].front()),
+				kcal_b = foods.kcal(members[b].front());
+			if (kcal_a != kcal_b)
+				return kcal_a < kcal_b;
+			return foods.protein_g(members[a].front()) > foods.protein_g(members[b].front());
+		});
+
+		std::vector<bool> keep(members.size(), true);
+		RankCounter dominators(proteins.size());
+		for (size_t g : order) {
+			const size_t rank = std::lower_bound(proteins.begin(), proteins.end(),
+				-foods.protein_g(members[g].front())) - proteins.begin();
+			if (dominators.prefix(rank) >= max_items)
+				keep[g] = false;
+			dominators.add(rank, members[g].size());
+		}
+
+		for (size_t g = 0; g < members.size(); g++) {
+			if (!keep[g])
+				continue;
+			for (size_t i : members[g]) {
+				_foods.push_back(foods.amount_g(i), foods.kcal(i), foods.protein_g(i));
+				_original.push_back(i);
+			}
+			_group_begin.push_back(_foods.size());
+		}
+	}
+
+	// The reduced problem.
+	const FoodTable& foods() const { return _foods; }
+
+	size_t group_count() const { return _group_begin.size() - 1; }
+
+	// Index in foods() of the first copy of group g.
+	size_t group_begin(size_t g) const {
+		assert(g < group_count());
+		return _group_begin[g];
+	}
+
+	// Number of copies of group g in foods().
+	size_t group_copies(size_t g) const {
+		assert(g < group_count());
+		return _group_begin[g + 1] - _group_begin[g];
+	}
+
+	// Number of foods removed from the original table.
+	size_t removed(const FoodTable& foods) const {
+		return foods.size() - _foods.size();
+	}
+
+	// Map indices into foods() to sorted indices into the original table.
+	IndexVector original(const IndexVector& reduced) const {
+		IndexVector result;
+		result.reserve(reduced.size());
+		for (size_t i : reduced) {
+			assert(i < _original.size());
+			result.push_back(_original[i]);
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	// Map a number of copies to take from each group to sorted indices
+	// into the original table.
+	IndexVector original_counts(const std::vector<size_t>& copies) const {
+		assert(copies.size() == group_count());
+		IndexVector reduced;
+		for (size_t g = 0; g < copies.size(); g++) {
+			assert(copies[g] <= group_copies(g));
+			for (size_t c = 0; c < copies[g]; c++)
+				reduced.push_back(_group_begin[g] + c);
+		}
+		return original(reduced);
+	}
+};
+
+// Run an exact solver, a callable taking (const FoodTable&, int) and
+// returning an IndexVector, on the FoodReduction of foods, and map its
+// answer back to indices into foods.
+template <typename Solver>
+IndexVector reduced_max_protein(const FoodTable& foods, int total_kcal, Solver solver) {
+	FoodReduction reduction(foods, total_kcal);
+	return reduction.original(solver(reduction.foods(), total_kcal));
+}
+
+template <typename Solver>
+std::unique_ptr<FoodVector> reduced_max_protein(const FoodVector& foods,
+	int total_kcal,
+	Solver solver) {
+	return select_foods(foods, reduced_max_protein(FoodTable::numbers(foods), total_kcal, solver));
+}
+
+// Exhaustive search over the FoodReduction of foods, treating each
+// group of identical foods as one item taken 0 to its copy count
+// times. This visits the product of (copies + 1) over the groups
+// instead of 2^n subsets.
+IndexVector exhaustive_max_protein_reduced(const FoodTable& foods, int total_kcal) {
+	FoodReduction reduction(foods, total_kcal);
+	const size_t groups = reduction.group_count();
+	const FoodTable& reduced = reduction.foods();
+
+	std::vector<size_t> copies(groups, 0), best_copies(groups, 0);
+	int kcal = 0, protein_g = 0, best_protein_g = 0;
+	//Count in mixed radix, digit g running from 0 to group_copies(g)
+	for (;;) {
+		size_t g = 0;
+		for (; g < groups; g++) {
+			const size_t item = reduction.group_begin(g);
+			if (copies[g] < reduction.group_copies(g)) {
+				copies[g]++;
+				kcal += reduced.kcal(item);
+				protein_g += reduced.protein_g(item);
+				break;
+			}
+			kcal -= int(copies[g]) * reduced.kcal(item);
+			protein_g -= int(copies[g]) * reduced.protein_g(item);
+			copies[g] = 0;
+		}
+		if (g == groups)
+			break;
+		if (kcal <= total_kcal && protein_g > best_protein_g) {
+			best_protein_g = protein_g;
+			best_copies = copies;
+		}
+	}
+	return reduction.original_counts(best_copies);
+}
+
+std::unique_ptr<FoodVector> exhaustive_max_protein_reduced(const FoodVector& foods,
+	int total_kcal) {
+	return select_foods(foods, exhaustive_max_protein_reduced(FoodTable::numbers(foods), total_kcal));
+}
+
+// The word-parallel core of bitset_max_protein, with ItemIndex wide
+// enough to number the rows. reach holds one bitset of reachable kcal
+// totals, 0 to total_kcal, per protein level, and first records, for
+// every reachable (protein, kcal) state, the row that first reached
+// it; first takes levels * (total_kcal + 1) ItemIndex values. Each
+// state was first reached from one that earlier rows already reached,
+// so following first back from the answer never uses a row twice.
+template <typename ItemIndex>
+IndexVector bitset_reachability(const FoodTable& foods,
+	int total_kcal,
+	const IndexVector& rows,
+	int levels) {
+	const size_t words = size_t(total_kcal) / 64 + 1,
+		states = size_t(total_kcal) + 1;
+	const int spare_bits = 63 - total_kcal % 64;
+	const uint64_t last_word_mask = ~uint64_t(0) >> spare_bits;
+
+	std::vector<uint64_t> reach(size_t(levels) * words, 0);
+	std::vector<ItemIndex> first(size_t(levels) * states);
+	reach[0] = 1;
+
+	//Words of a level below lowest[level] are all zero
+	std::vector<size_t> lowest(levels, words);
+	lowest[0] = 0;
+
+	int top = 0;
+	for (size_t row = 0; row < rows.size(); row++) {
+		const int kcal = foods.kcal(rows[row]),
+			protein_g = foods.protein_g(rows[row]);
+		const size_t word_shift = kcal / 64;
+		const int bit_shift = kcal % 64;
+		const int highest = std::min(top + protein_g, levels - 1);
+
+		//reach[p] |= reach[p - protein_g] << kcal, from the top level
+		//down so each row is used at most once
+		for (int p = highest; p >= protein_g; p--) {
+			const size_t begin = lowest[p - protein_g] + word_shift;
+			if (begin >= words)
+				continue;
+			const uint64_t* from = &reach[size_t(p - protein_g) * words];
+			uint64_t* to = &reach[size_t(p) * words];
+			for (size_t w = words; w-- > begin; ) {
+				uint64_t shifted = from[w - word_shift] << bit_shift;
+				if (bit_shift != 0 && w > word_shift)
+					shifted |= from[w - word_shift - 1] >> (64 - bit_shift);
+				if (w == words - 1)
+					shifted &= last_word_mask;
+				uint64_t fresh = shifted & ~to[w];
+				if (fresh == 0)
+					continue;
+				to[w] |= fresh;
+				lowest[p] = std::min(lowest[p], w);
+				for (; fresh != 0; fresh &= fresh - 1)
+					first[size_t(p) * states + w * 64 + lowest_set_bit(fresh)] = ItemIndex(row);
+			}
+		}
+		top = highest;
+	}
+
+	//The highest reachable level, at its lowest kcal total
+	int p = top;
+	while (p > 0 && lowest[p] == words)
+		p--;
+	IndexVector result;
+	if (p == 0)
+		return result;
+	int kcal = int(lowest[p] * 64) + lowest_set_bit(reach[size_t(p) * words + lowest[p]]);
+	while (p > 0) {
+		const int row = first[size_t(p) * states + kcal];
+		result.push_back(rows[row]);
+		p -= foods.protein_g(rows[row]);
+		kcal -= foods.kcal(rows[row]);
+	}
+	assert(kcal == 0);
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+// Compute the optimal set of foods with a bitset reachability DP. For
+// every protein level up to the LP relaxation bound, a bitset records
+// which kcal totals up to total_kcal some subset reaches with exactly
+// that much protein, and each food updates it with word-level shifts,
+// reach[p] |= reach[p - protein] << kcal, 64 states per operation. The
+// answer is the highest level with any reachable total. The result has
+// the same total protein as exhaustive_max_protein and takes
+// O(n * P * total_kcal / 64) time, where P is the bound. Reconstructing
+// the foods, which are returned in their original order, takes two or
+// four bytes per (level, kcal) state, 16 or 32 times the bitsets
+// themselves, and dominates the memory use: about 86 MB at 14000 kcal
+// on the USDA data, against 13 MB of choice bits for
+// dynamic_max_protein, so prefer that for large budgets. The foods
+// FoodReduction would remove are left out first, which shrinks n
+// several times over on the USDA data.
+IndexVector bitset_max_protein(const FoodTable& foods,
+	int total_kcal) {
+	if (total_kcal < 0) {
+		return IndexVector();
+	}
+
+	//FoodReduction drops foods that cannot matter, often most of them
+	FoodReduction reduction(foods, total_kcal);
+	const FoodTable& reduced = reduction.foods();
+	IndexVector rows(reduced.size());
+	for (size_t i = 0; i < rows.size(); i++)
+		rows[i] = i;
+	const int levels = int(std::floor(lp_relaxation_bound(reduced, total_kcal))) + 1;
+	if (rows.size() <= 0xFFFF)
+		return reduction.original(bitset_reachability<uint16_t>(reduced, total_kcal, rows, levels));
+	return reduction.original(bitset_reachability<uint32_t>(reduced, total_kcal, rows, levels));
+}
+
+std::unique_ptr<FoodVector> bitset_max_protein(const FoodVector& foods,
+	int total_kcal) {
+	return select_foods(foods, bitset_max_protein(FoodTable::numbers(foods), total_kcal));
+}
+
+// The engines max_protein can dispatch to.
+enum class SolverEngine {
+	// Let choose_solver decide.
+	AUTO,
+
+	// Approximate: greedy_max_protein with BEST_OF_BOTH.
+	GREEDY,
+
+	// Approximate: local_search_max_protein.
+	LOCAL_SEARCH,
+
+	// Exact: exhaustive_max_protein_simd.
+	EXHAUSTIVE,
+
+	// Exact: meet_in_middle_max_protein.
+	MEET_IN_MIDDLE,
+
+	// Exact: dynamic_max_protein.
+	DYNAMIC,
+
+	// Exact: bitset_max_protein. AUTO never picks it.
+	BITSET,
+
+	// Exact: dynamic_max_protein_low_memory. AUTO never picks it.
+	DYNAMIC_LOW_MEMORY,
+
+	// Exact: branch_and_bound_max_protein.
+	BRANCH_AND_BOUND,
+
+	// Best effort within SolverOptions::time_limit: anytime_max_protein.
+	ANYTIME
+};
+
+// Knobs for max_protein. The default thresholds come from the
+// maxprotein benchmark on ABBREV.txt at 2000 kcal: the SIMD exhaustive
+// search beats meet in the middle up to about 12 foods, meet in the
+// middle stays under 50 microseconds up to 50 foods, and beyond that
+// branch and bound usually proves optimality within a few thousand
+// nodes, over ten times faster than dynamic programming, which is kept
+// as the fallback because its running time does not depend on the data.
+struct SolverOptions {
+	// Engine to use; AUTO picks one with choose_solver.
+	SolverEngine engine;
+
+	// Largest number of foods for EXHAUSTIVE.
+	int exhaustive_max_n;
+
+	// Largest number of foods for MEET_IN_MIDDLE.
+	int meet_in_middle_max_n;
+
+	// Largest choice-bit table, in bytes, for DYNAMIC.
+	size_t dynamic_max_bytes;
+
+	// Nodes for the branch and bound attempt made before DYNAMIC in
+	// AUTO mode, or zero to go straight to DYNAMIC.
+	uint64_t branch_and_bound_node_limit;
+
+	// Deadline in seconds, or zero for none. With a deadline, AUTO
+	// uses ANYTIME instead of DYNAMIC and BRANCH_AND_BOUND.
+	double time_limit;
+
+	SolverOptions()
+		: engine(SolverEngine::AUTO),
+		exhaustive_max_n(12),
+		meet_in_middle_max_n(50),
+		dynamic_max_bytes(size_t(64) << 20),
+		branch_and_bound_node_limit(100000),
+		time_limit(0) { }
+};
+
+// Return the engine max_protein runs for foods and total_kcal under
+// options: options.engine itself unless it is AUTO, and otherwise
+// EXHAUSTIVE for tiny inputs, MEET_IN_MIDDLE for small ones, ANYTIME
+// when there is a deadline, DYNAMIC when its table fits in
+// dynamic_max_bytes, and BRANCH_AND_BOUND otherwise.
+SolverEngine choose_solver(const FoodTable& foods,
+	int total_kcal,
+	const SolverOptions& options = SolverOptions()) {
+	if (options.engine != SolverEngine::AUTO)
+		return options.engine;
+
+	const int n = foods.size();
+	if (n <= options.exhaustive_max_n && n < 64)
+		return SolverEngine::EXHAUSTIVE;
+	if (n <= options.meet_in_middle_max_n && n < 64)
+		return SolverEngine::MEET_IN_MIDDLE;
+	if (options.time_limit > 0)
+		return SolverEngine::ANYTIME;
+	//Same size as KnapsackTable's choice bits
+	const double dynamic_bytes = double(n) * (std::max(total_kcal, 0) / 64 + 1) * 8;
+	if (dynamic_bytes <= double(options.dynamic_max_bytes))
+		return SolverEngine::DYNAMIC;
+	return SolverEngine::BRANCH_AND_BOUND;
+}
+
+// Compute a set of foods with the most protein within total_kcal,
+// using the engine choose_solver picks, so callers need not know which
+// solver is fastest for their input. Results are exact except for
+// GREEDY, LOCAL_SEARCH, and ANYTIME cut short by its deadline. When
+// AUTO picks DYNAMIC, branch and bound gets the first
+// branch_and_bound_node_limit nodes, and its answer is kept if it is
+// proven optimal in that time. The overloads taking stats fill in
+// whatever the chosen engine records, and at least the solve time and
+// the gap to the LP bound. The overloads taking a workspace use its
+// buffers for the greedy, exhaustive and dynamic programming engines,
+// write the chosen indices to out, and return how many there are; see
+// copy_indices.
+template <bool ENABLED>
+size_t max_protein(const FoodTable& foods,
+	int total_kcal,
+	SolverWorkspace& workspace,
+	int* out,
+	size_t capacity,
+	const SolverOptions& options,
+	SolveStats<ENABLED>& stats) {
+	IndexVector& result = workspace.selection;
+	result.clear();
+	if (total_kcal < 0) {
+		return 0;
+	}
+
+	const SolverEngine engine = choose_solver(foods, total_kcal, options);
+	bool proven_optimal = false;
+	if (engine == SolverEngine::BRANCH_AND_BOUND) {
+		result = branch_and_bound_max_protein(foods, total_kcal, proven_optimal, stats);
+	}
+	else if (engine == SolverEngine::DYNAMIC_LOW_MEMORY) {
+		result = dynamic_max_protein_low_memory(foods, total_kcal, stats);
+	}
+	else if (engine == SolverEngine::DYNAMIC) {
+		if (options.engine == SolverEngine::AUTO && options.branch_and_bound_node_limit > 0) {
+			result = branch_and_bound_max_protein(foods,
+				total_kcal,
+				proven_optimal,
+				stats,
+				options.branch_and_bound_node_limit);
+		}
+		if (!proven_optimal)
+			dynamic_max_protein(foods, total_kcal, workspace, nullptr, 0, stats);
+	}
+	else {
+		stats.begin_phase();
+		switch (engine) {
+		case SolverEngine::GREEDY:
+			greedy_max_protein(foods, total_kcal, workspace, nullptr, 0,
+				GreedyStrategy::BEST_OF_BOTH);
+			break;
+		case SolverEngine::LOCAL_SEARCH:
+			result = local_search_max_protein(foods, total_kcal);
+			break;
+		case SolverEngine::EXHAUSTIVE:
+			exhaustive_max_protein(foods, total_kcal, workspace, nullptr, 0);
+			break;
+		case SolverEngine::MEET_IN_MIDDLE:
+			result = meet_in_middle_max_protein(foods, total_kcal);
+			break;
+		case SolverEngine::BITSET:
+			result = bitset_max_protein(foods, total_kcal);
+			break;
+		default:
+			result = anytime_max_protein(foods,
+				total_kcal,
+				std::chrono::duration<double>(options.time_limit),
+				proven_optimal);
+			break;
+		}
+		stats.end_phase(StatsPhase::SOLVE);
+		finish_stats(stats, foods, total_kcal, result);
+	}
+	return copy_indices(result, out, capacity);
+}
+
+size_t max_protein(const FoodTable& foods,
+	int total_kcal,
+	SolverWorkspace& workspace,
+	int* out,
+	size_t capacity,
+	const SolverOptions& options = SolverOptions()) {
+	NullStats stats;
+	return max_protein(foods, total_kcal, workspace, out, capacity, options, stats);
+}
+
+template <bool ENABLED>
+IndexVector max_protein(const FoodTable& foods,
+	int total_kcal,
+	const SolverOptions& options,
+	SolveStats<ENABLED>& stats) {
+	SolverWorkspace workspace;
+	max_protein(foods, total_kcal, workspace, nullptr, 0, options, stats);
+	return std::move(workspace.selection);
+}
+
+IndexVector max_protein(const FoodTable& foods,
+	int total_kcal,
+	const SolverOptions& options = SolverOptions()) {
+	NullStats stats;
+	return max_protein(foods, total_kcal, options, stats);
+}
+
+std::unique_ptr<FoodVector> max_protein(const FoodVector& foods,
+	int total_kcal,
+	const SolverOptions& options = SolverOptions()) {
+	return select_foods(foods, max_protein(FoodTable::numbers(foods), total_kcal, options));
+}
+
+// An upper limit on the total amount of one nutrient.
+struct NutrientLimit {
+	Nutrient nutrient;
+	int max;
+};
+
+// Branch and bound for foods under a kcal budget and any number of
+// NutrientLimits, a multidimensional knapsack. Every extra constraint
+// c gets a Lagrange multiplier lambda[c] >= 0, tuned at the root by
+// subgradient optimization, and the bound at a node with value v and
+// remaining capacities R is
+//
+//    v + sum(lambda[c] * R[c]) + LP(remaining foods, profits p - lambda.a, R[kcal])
+//
+// which holds for any lambda >= 0. With the foods sorted once by
+// adjusted profit per kcal, the LP term is a prefix-sum lookup just as
+// in BranchAndBound, so adding constraints costs O(constraints) per
+// node instead of weakening the bound to kcal alone. Before searching,
+// foods whose inclusion alone would push the root bound below the
+// incumbent are fixed out, which removes most foods on USDA data.
+class MultiConstraintSearch {
+private:
+	// Number of extra constraints, and the capacity of each, kcal first.
+	size_t _limits;
+	std::vector<int> _capacity;
+
+	// Original index of each candidate food, in branching order, with
+	// its protein, its adjusted profit, and its weights, _limits + 1 per
+	// food with kcal first.
+	IndexVector _order;
+	std::vector<int> _protein_g, _weight;
+	std::vector<double> _profit;
+
+	std::vector<double> _lambda;
+
+	// Prefix sums over the branching order of kcal and of the adjusted
+	// profit, over the _positive foods whose adjusted profit is positive.
+	size_t _positive;
+	std::vector<int64_t> _prefix_kcal;
+	std::vector<double> _prefix_profit;
+
+	// Search state, and the incumbent as original indices.
+	std::vector<int> _remaining;
+	std::vector<char> _taken;
+	IndexVector _best;
+	int _best_protein_g;
+	uint64_t _node_limit, _nodes;
+	double _time_limit;
+	bool _aborted;
+	Timer _timer;
+
+	int weight(size_t item, size_t c) const { return _weight[item * (_limits + 1) + c]; }
+
+	// Solve the kcal-only LP over all candidates under multipliers
+	// lambda: return its value plus sum(lambda * capacity), and set
+	// usage to the amount of each extra resource the solution uses.
+	double relaxed(const std::vector<double>& lambda, std::vector<double>& usage) const {
+		const size_t n = _order.size();
+		std::vector<double> profit(n);
+		IndexVector items;
+		for (size_t i = 0; i < n; i++) {
+			profit[i] = _protein_g[i];
+			for (size_t c = 0; c < _limits; c++)
+				profit[i] -= lambda[c] * weight(i, c + 1);
+			if (profit[i] > 0)
+				items.push_back(i);
+		}
+		std::sort(items.begin(), items.end(), [&](int a, int b) {
+			return profit[a] * weight(b, 0) > profit[b] * weight(a, 0);
+		});
+
+		double value = 0;
+		for (size_t c = 0; c < _limits; c++)
+			value += lambda[c] * _capacity[c + 1];
+		usage.assign(_limits, 0);
+		double remaining = _capacity[0];
+		for (int i : items) {
+			const double fraction = (weight(i, 0) <= remaining) ? 1 : remaining / weight(i, 0);
+			value += fraction * profit[i];
+			for (size_t c = 0; c < _limits; c++)
+				usage[c] += fraction * weight(i, c + 1);
+			remaining -= fraction * weight(i, 0);
+			if (fraction < 1)
+				break;
+		}
+		return value;
+	}
+
+	// Set _lambda by subgradient optimization of the root bound, with
+	// the incumbent as the target.
+	void tune_multipliers() {
+		std::vector<double> lambda(_limits, 0), usage;
+		_lambda = lambda;
+		double best_bound = relaxed(lambda, usage), step_scale = 2;
+		for (int iteration = 0; iteration < 100 && _limits > 0; iteration++) {
+			const double bound = relaxed(lambda, usage);
+			if (bound < best_bound) {
+				best_bound = bound;
+				_lambda = lambda;
+			}
+			else if (iteration % 10 == 9) {
+				step_scale /= 2;
+			}
+			double norm = 0;
+			std::vector<double> gradient(_limits);
+			for (size_t c = 0; c < _limits; c++) {
+				gradient[c] = usage[c] - _capacity[c + 1];
+				//Multipliers at zero cannot go lower
+				if (lambda[c] == 0 && gradient[c] < 0)
+					gradient[c] = 0;
+				norm += gradient[c] * gradient[c];
+			}
+			if (norm == 0 || best_bound - _best_protein_g < 1)
+				break;
+			const double step = step_scale * (bound - _best_protein_g) / norm;
+			for (size_t c = 0; c < _limits; c++)
+				lambda[c] = std::max(0.0, lambda[c] + step * gradient[c]);
+		}
+	}
+
+	// Keep only the candidates at positions keep, in that order, and
+	// rebuild the prefix sums.
+	void arrange(const IndexVector& keep) {
+		IndexVector order;
+		std::vector<int> protein_g, weights;
+		std::vector<double> profit;
+		for (int k : keep) {
+			order.push_back(_order[k]);
+			protein_g.push_back(_protein_g[k]);
+			profit.push_back(_profit[k]);
+			weights.insert(weights.end(),
+				_weight.begin() + k * (_limits + 1),
+				_weight.begin() + (k + 1) * (_limits + 1));
+		}
+		_order.swap(order);
+		_protein_g.swap(protein_g);
+		_profit.swap(profit);
+		_weight.swap(weights);
+
+		const size_t n = _order.size();
+		_positive = 0;
+		while (_positive < n && _profit[_positive] > 0)
+			_positive++;
+		_prefix_kcal.assign(n + 1, 0);
+		_prefix_profit.assign(n + 1, 0);
+		for (size_t k = 0; k < n; k++) {
+			_prefix_kcal[k + 1] = _prefix_kcal[k] + weight(k, 0);
+			_prefix_profit[k + 1] = _prefix_profit[k] + std::max(_profit[k], 0.0);
+		}
+		_remaining = _capacity;
+		_taken.assign(n, 0);
+	}
+
+	// Index of the LP break food for a node at depth with the current
+	// remaining kcal: foods [depth, result) all fit.
+	size_t break_item(size_t depth) const {
+		return std::upper_bound(_prefix_kcal.begin() + depth,
+			_prefix_kcal.begin() + _positive + 1,
+			_prefix_kcal[depth] + _remaining[0]) - _prefix_kcal.begin() - 1;
+	}
+
+	double bound(size_t depth, int value) const {
+		double result = value;
+		for (size_t c = 0; c < _limits; c++)
+			result += _lambda[c] * _remaining[c + 1];
+		if (depth >= _positive)
+			return result;
+		const size_t t = break_item(depth);
+		result += _prefix_profit[t] - _prefix_profit[depth];
+		if (t < _positive) {
+			const double left = _remaining[0] - (_prefix_kcal[t] - _prefix_kcal[depth]);
+			result += left * _profit[t] / weight(t, 0);
+		}
+		return result;
+	}
+
+	bool fits(size_t item) const {
+		for (size_t c = 0; c <= _limits; c++) {
+			if (weight(item, c) > _remaining[c])
+				return false;
+		}
+		return true;
+	}
+
+	void take(size_t item, int sign) {
+		for (size_t c = 0; c <= _limits; c++)
+			_remaining[c] -= sign * weight(item, c);
+		_taken[item] = (sign > 0);
+	}
+
+	// Take every candidate that still fits, in the order given, and
+	// make the result the incumbent if it is better.
+	void greedy(const IndexVector& order) {
+		_remaining = _capacity;
+		_taken.assign(_order.size(), 0);
+		int protein_g = 0;
+		for (int i : order) {
+			if (fits(i)) {
+				take(i, 1);
+				protein_g += _protein_g[i];
+			}
+		}
+		if (protein_g > _best_protein_g)
+			record(protein_g);
+	}
+
+	void record(int protein_g) {
+		_best_protein_g = protein_g;
+		_best.clear();
+		for (size_t i = 0; i < _order.size(); i++) {
+			if (_taken[i])
+				_best.push_back(_order[i]);
+		}
+	}
+
+	void search(size_t depth, int value) {
+		if (_aborted) {
+			return;
+		}
+		_nodes++;
+		if ((_node_limit != 0 && _nodes > _node_limit) ||
+			(_time_limit > 0 && (_nodes % 1024) == 0 &&
+			_timer.elapsed() > _time_limit)) {
+			_aborted = true;
+			return;
+		}
+
+		if (value > _best_protein_g)
+			record(value);
+		//Protein totals are integers, so a bound below best + 1 prunes
+		if (depth == _order.size() || bound(depth, value) < _best_protein_g + 1 - 1e-9) {
+			return;
+		}
+
+		if (fits(depth)) {
+			take(depth, 1);
+			search(depth + 1, value + _protein_g[depth]);
+			take(depth, -1);
+		}
+		search(depth + 1, value);
+	}
+
+public:
+	// Prepare a search over foods. Foods without protein, too heavy in
+	// any one resource, or missing a limited nutrient are left out.
+	MultiConstraintSearch(const FoodVector& foods,
+		int total_kcal,
+		const std::vector<NutrientLimit>& limits)
+		: _limits(limits.size()),
+		_positive(0),
+		_best_protein_g(0),
+		_node_limit(0),
+		_nodes(0),
+		_time_limit(0),
+		_aborted(false) {
+
+		assert(total_kcal >= 0);
+		_capacity.push_back(total_kcal);
+		for (const auto& limit : limits) {
+			assert(limit.max >= 0);
+			_capacity.push_back(limit.max);
+		}
+
+		for (int i = 0; i < int(foods.size()); i++) {
+			const Food& food = *foods[i];
+			bool ok = food.protein_g() > 0 && food.kcal() <= total_kcal;
+			for (size_t c = 0; ok && c < _limits; c++) {
+				ok = food.has_nutrient(limits[c].nutrient) &&
+					food.nutrient(limits[c].nutrient) <= limits[c].max;
+			}
+			if (!ok)
+				continue;
+			_order.push_back(i);
+			_protein_g.push_back(food.protein_g());
+			_weight.push_back(food.kcal());
+			for (const auto& limit : limits)
+				_weight.push_back(food.nutrient(limit.nutrient));
+		}
+		const size_t n = _order.size();
+		IndexVector positions(n);
+		for (size_t i = 0; i < n; i++)
+			positions[i] = i;
+
+		//Multipliers are tuned against a density greedy incumbent
+		IndexVector by_density = positions;
+		std::sort(by_density.begin(), by_density.end(), [&](int a, int b) {
+			return denser(_protein_g[a], weight(a, 0), _protein_g[b], weight(b, 0));
+		});
+		greedy(by_density);
+		tune_multipliers();
+
+		//Branch in order of adjusted profit per kcal, positive ones first
+		_profit.resize(n);
+		for (size_t i = 0; i < n; i++) {
+			_profit[i] = _protein_g[i];
+			for (size_t c = 0; c < _limits; c++)
+				_profit[i] -= _lambda[c] * weight(i, c + 1);
+		}
+		std::sort(positions.begin(), positions.end(), [&](int a, int b) {
+			if ((_profit[a] > 0) != (_profit[b] > 0))
+				return _profit[a] > 0;
+			if (_profit[a] * weight(b, 0) != _profit[b] * weight(a, 0))
+				return _profit[a] * weight(b, 0) > _profit[b] * weight(a, 0);
+			return a < b;
+		});
+		arrange(positions);
+		for (size_t k = 0; k < n; k++)
+			positions[k] = k;
+		greedy(positions);
+
+		//Forcing food k into the LP changes its value by at most
+		//profit - kcal * (the break food's ratio), so foods that could
+		//not reach best + 1 even then are fixed out
+		_remaining = _capacity;
+		const double root = bound(0, 0);
+		const size_t t = break_item(0);
+		const double ratio = (t < _positive) ? _profit[t] / weight(t, 0) : 0;
+		IndexVector keep;
+		for (size_t k = 0; k < n; k++) {
+			if (k < t || root + _profit[k] - ratio * weight(k, 0) >= _best_protein_g + 1 - 1e-9)
+				keep.push_back(k);
+		}
+		arrange(keep);
+	}
+
+	// Search until the incumbent is proven optimal, node_limit nodes
+	// have been visited, or time_limit seconds have passed, where zero
+	// means no limit. Returns true when the incumbent is proven optimal.
+	bool run(uint64_t node_limit = 0, double time_limit = 0) {
+		_node_limit = node_limit;
+		_time_limit = time_limit;
+		_nodes = 0;
+		_aborted = false;
+		_timer.reset();
+		_remaining = _capacity;
+		_taken.assign(_order.size(), 0);
+		search(0, 0);
+		return !_aborted;
+	}
+
+	// Original indices of the incumbent foods, in ascending order.
+	IndexVector best() const {
+		IndexVector result = _best;
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	int best_protein_g() const { return _best_protein_g; }
+	uint64_t nodes() const { return _nodes; }
+
+	// Number of foods left to branch on after fixing.
+	size_t candidates() const { return _order.size(); }
+
+	const std::vector<double>& multipliers() const { return _lambda; }
+};
+
+// Compute the set of foods with the most protein within total_kcal
+// and every one of limits, using MultiConstraintSearch seeded with a
+// greedy solution. Foods that lack a limited nutrient are never
+// chosen. The search stops after node_limit nodes or time_limit
+// seconds, where zero means no limit, and proven_optimal tells whether
+// it finished. The selected foods are returned in their original
+// order.
+IndexVector constrained_max_protein(const FoodVector& foods,
+	int total_kcal,
+	const std::vector<NutrientLimit>& limits,
+	bool& proven_optimal,
+	uint64_t node_limit = 0,
+	double time_limit = 0) {
+	if (total_kcal < 0) {
+		proven_optimal = true;
+		return IndexVector();
+	}
+	for (const auto& limit : limits) {
+		if (limit.max < 0) {
+			proven_optimal = true;
+			return IndexVector();
+		}
+	}
+	MultiConstraintSearch search(foods, total_kcal, limits);
+	proven_optimal = search.run(node_limit, time_limit);
+	return search.best();
+}
+
+std::unique_ptr<FoodVector> constrained_max_protein(const FoodVector& foods,
+	int total_kcal,
+	const std::vector<NutrientLimit>& limits) {
+	bool proven_optimal;
+	return select_foods(foods,
+		constrained_max_protein(foods, total_kcal, limits, proven_optimal));
+}
+
+// Load the foods of load_usda_abbrev_filtered(path, min_kcal,
+// max_kcal, total_size) into a FoodTable that is never modified, so
+// any number of threads, such as those of a SolveService, can share
+// one copy. Returns nullptr on I/O error or a malformed file.
+std::shared_ptr<const FoodTable> load_shared_food_table(const std::string& path,
+	int min_kcal,
+	int max_kcal,
+	int total_size) {
+	auto foods = load_usda_abbrev_filtered(path, min_kcal, max_kcal, total_size);
+	if (!foods) {
+		return nullptr;
+	}
+	return std::make_shared<const FoodTable>(*foods);
+}
+
+// A first-in first-out queue holding at most capacity items, which any
+// number of threads may push to and pop from. After close, pushes fail
+// and pops drain whatever is left.
+template <typename T>
+class BoundedQueue {
+private:
+	std::mutex _mutex;
+	std::condition_variable _not_empty, _not_full;
+	std::queue<T> _items;
+	size_t _capacity;
+	bool _closed;
+
+public:
+	explicit BoundedQueue(size_t capacity) : _capacity(capacity), _closed(false) {
+		assert(capacity > 0);
+	}
+
+	size_t capacity() const { return _capacity; }
+
+	size_t size() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _items.size();
+	}
+
+	// Add item, waiting while the queue is full. Returns false, leaving
+	// item alone, if the queue is closed.
+	bool push(T& item) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_not_full.wait(lock, [this]() { return _closed || _items.size() < _capacity; });
+		if (_closed) {
+			return false;
+		}
+		_items.push(std::move(item));
+		_not_empty.notify_one();
+		return true;
+	}
+
+	// Add item if there is room right now. Returns false, leaving item
+	// alone, if the queue is full or closed.
+	bool try_push(T& item) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_closed || _items.size() >= _capacity) {
+			return false;
+		}
+		_items.push(std::move(item));
+		_not_empty.notify_one();
+		return true;
+	}
+
+	// Move the oldest item into item, waiting while the queue is empty.
+	// Returns false once the queue is closed and empty.
+	bool pop(T& item) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_not_empty.wait(lock, [this]() { return _closed || !_items.empty(); });
+		if (_items.empty()) {
+			return false;
+		}
+		item = std::move(_items.front());
+		_items.pop();
+		_not_full.notify_one();
+		return true;
+	}
+
+	void close() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_closed = true;
+		_not_empty.notify_all();
+		_not_full.notify_all();
+	}
+};
+
+// Called on a worker thread with the answer to one request and a null
+// exception_ptr, or, if the solve threw, an empty answer and the
+// exception. Exceptions the callback itself throws are discarded.
+typedef std::function<void(const IndexVector&, std::exception_ptr)> SolveCallback;
+
+// Answers max_protein requests against one shared, read-only FoodTable
+// on a fixed pool of worker threads, so callers do not each load and
+// filter ABBREV.txt. Requests wait on a BoundedQueue; submit blocks
+// while it is full and try_submit fails instead, so a burst of
+// requests cannot grow memory without bound. Each worker keeps its own
+// SolverWorkspace for max_protein, so greedy, exhaustive and dynamic
+// programming solves reuse their buffers from one request to the next.
+// Results are indices into foods(), delivered through a future or a
+// callback.
+class SolveService {
+private:
+	struct Job {
+		int total_kcal;
+		SolverOptions options;
+		std::promise<IndexVector> promise;
+		SolveCallback callback;
+	};
+
+	std::shared_ptr<const FoodTable> _foods;
+	BoundedQueue<Job> _queue;
+	std::vector<std::thread> _workers;
+
+	void work() {
+		SolverWorkspace workspace;
+		Job job;
+		while (_queue.pop(job)) {
+			std::exception_ptr error;
+			try {
+				max_protein(*_foods, job.total_kcal, workspace, nullptr, 0, job.options);
+			}
+			catch (...) {
+				error = std::current_exception();
+				workspace.selection.clear();
+			}
+			if (!job.callback) {
+				if (error)
+					job.promise.set_exception(error);
+				else
+					job.promise.set_value(workspace.selection);
+				continue;
+			}
+			//An exception from the callback has nowhere to go, and must
+			//not end the worker
+			try {
+				job.callback(workspace.selection, error);
+			}
+			catch (...) { }
+		}
+	}
+
+public:
+	// Start the given number of worker threads, or one per hardware
+	// thread when workers is zero, with room for queue_capacity waiting
+	// requests.
+	explicit SolveService(std::shared_ptr<const FoodTable> foods,
+		unsigned workers = 0,
+		size_t queue_capacity = 64)
+		: _foods(foods), _queue(queue_capacity) {
+		assert(foods);
+		if (workers == 0)
+			workers = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned i = 0; i < workers; i++)
+			_workers.push_back(std::thread(&SolveService::work, this));
+	}
+
+	~SolveService() { shutdown(); }
+
+	SolveService(const SolveService&) = delete;
+	SolveService& operator=(const SolveService&) = delete;
+
+	const FoodTable& foods() const { return *_foods; }
+	unsigned workers() const { return _workers.size(); }
+
+	// Queue a request, waiting while the queue is full, and return the
+	// future answer. After shutdown the future holds a broken_promise
+	// future_error instead.
+	std::future<IndexVector> submit(int total_kcal,
+		const SolverOptions& options = SolverOptions()) {
+		Job job;
+		job.total_kcal = total_kcal;
+		job.options = options;
+		std::future<IndexVector> result = job.promise.get_future();
+		_queue.push(job);
+		return result;
+	}
+
+	// Queue a request if there is room right now, setting result to its
+	// future answer. Returns false if the queue is full or shut down.
+	bool try_submit(int total_kcal,
+		std::future<IndexVector>& result,
+		const SolverOptions& options = SolverOptions()) {
+		Job job;
+		job.total_kcal = total_kcal;
+		job.options = options;
+		std::future<IndexVector> future = job.promise.get_future();
+		if (!_queue.try_push(job)) {
+			return false;
+		}
+		result = std::move(future);
+		return true;
+	}
+
+	// Queue a request if there is room right now, to be answered by
+	// calling callback on a worker thread. Returns false if the queue is
+	// full or shut down.
+	bool try_submit(int total_kcal,
+		SolveCallback callback,
+		const SolverOptions& options = SolverOptions()) {
+		assert(callback);
+		Job job;
+		job.total_kcal = total_kcal;
+		job.options = options;
+		job.callback = std::move(callback);
+		return _queue.try_push(job);
+	}
+
+	// Stop accepting requests, answer the ones already queued, and wait
+	// for the workers to exit.
+	void shutdown() {
+		_queue.close();
+		for (auto& worker : _workers) {
+			if (worker.joinable())
+				worker.join();
+		}
+	}
+};
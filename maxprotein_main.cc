@@ -1,40 +1,247 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxprotein_main.cc
 //
-//#include "maxprotein.hh"
-//#include "timer.hh"
-//#include "cassert"
-//#include <iostream>
-//using namespace std;
-//int main() {
+// Benchmark driver for the solvers in maxprotein.hh. Every solver is
+// run over the first n foods of ABBREV.txt for each n in its sweep,
+// with warm-up iterations followed by timed trials, and the median,
+// 95th and 99th percentile wall times and the throughput are printed
+// as CSV, or as JSON with --json.
 //
+// Usage:
 //
-//	int n = 6000;
-//	auto all_foods = load_usda_abbrev("ABBREV.txt");
-//    assert( all_foods );
-//	//const std::unique_ptr<FoodVector> foodvector(new FoodVector);
-//	auto foodvector = filter_food_vector(*all_foods, 1, 2500, n);
-//	Timer timer;
-//	auto output = greedy_max_protein(*foodvector, 2000);
-//	double elapsed = timer.elapsed();
-//	cout << "greedy_max_protein, "
-//		<< "n=" << n << ", "
-//		<< "elapsed time=" << elapsed << " seconds" << endl;
-//		timer.reset();
-//		
-//		
-//		int n = 25;
-//		auto all_foods = load_usda_abbrev("ABBREV.txt");
-//		assert(all_foods);
-//		auto foodvector = filter_food_vector(*all_foods, 1, 2500, n);
-//		Timer timer;
-//		auto output = exhaustive_max_protein(*foodvector, 2000);
-//		double elapsed = timer.elapsed();
-//		cout << "exhuastive_max_protein, "
-//			<< "n=" << n << ", "
-//			<< "elapsed time=" << elapsed << " seconds" << endl;
-//		timer.reset();
+//    ./maxprotein [--trials N] [--warmup N] [--kcal W] [--json] [--solver NAME]
 //
-//
-//
-//		system("pause");
-//  return 0;
-//}
+///////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "maxprotein.hh"
+#include "timer.hh"
+
+// One solver to benchmark, and the sizes to run it at.
+struct BenchmarkSolver {
+	std::string name;
+
+	// What the throughput column counts: "subsets" for solvers whose
+	// work grows with 2^n, "items" otherwise.
+	std::string unit;
+
+	std::vector<int> sizes;
+	std::function<IndexVector(const FoodTable&, int)> solve;
+};
+
+// Summary of the timed trials of one solver at one size.
+struct BenchmarkResult {
+	double median, p95, p99, throughput;
+	int protein_g;
+};
+
+// The nearest-rank percentile p, in [0, 1], of sorted, which must not
+// be empty.
+double percentile(const std::vector<double>& sorted, double p) {
+	assert(!sorted.empty());
+	size_t rank = size_t(std::ceil(p * sorted.size()));
+	if (rank == 0)
+		rank = 1;
+	return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+BenchmarkResult run_benchmark(const BenchmarkSolver& solver,
+	const FoodTable& foods,
+	int total_kcal,
+	int warmup,
+	int trials) {
+	for (int i = 0; i < warmup; i++)
+		solver.solve(foods, total_kcal);
+
+	std::vector<double> times;
+	IndexVector selection;
+	Timer timer;
+	for (int i = 0; i < trials; i++) {
+		timer.reset();
+		selection = solver.solve(foods, total_kcal);
+		times.push_back(timer.elapsed());
+	}
+	std::sort(times.begin(), times.end());
+
+	BenchmarkResult result;
+	result.median = percentile(times, 0.5);
+	result.p95 = percentile(times, 0.95);
+	result.p99 = percentile(times, 0.99);
+	const double work = (solver.unit == "subsets") ?
+		std::ldexp(1.0, int(foods.size())) : double(foods.size());
+	result.throughput = (result.median > 0) ? work / result.median : 0;
+	result.protein_g = 0;
+	for (int i : selection)
+		result.protein_g += foods.protein_g(i);
+	return result;
+}
+
+std::vector<BenchmarkSolver> benchmark_solvers(int all_foods) {
+	std::vector<int> large;
+	for (int n : { 1000, 2000, 4000 }) {
+		if (n < all_foods)
+			large.push_back(n);
+	}
+	large.push_back(all_foods);
+
+	std::vector<BenchmarkSolver> solvers;
+	solvers.push_back({ "greedy_protein", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return greedy_max_protein(foods, total_kcal, GreedyStrategy::PROTEIN);
+		} });
+	solvers.push_back({ "greedy_density", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return greedy_max_protein(foods, total_kcal, GreedyStrategy::DENSITY);
+		} });
+	solvers.push_back({ "greedy_best_of_both", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return greedy_max_protein(foods, total_kcal, GreedyStrategy::BEST_OF_BOTH);
+		} });
+	solvers.push_back({ "local_search", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return local_search_max_protein(foods, total_kcal);
+		} });
+	solvers.push_back({ "exhaustive", "subsets", { 8, 12, 16, 20 },
+		[](const FoodTable& foods, int total_kcal) {
+			return exhaustive_max_protein(foods, total_kcal);
+		} });
+	solvers.push_back({ "exhaustive_gray", "subsets", { 8, 12, 16, 20 },
+		[](const FoodTable& foods, int total_kcal) {
+			return exhaustive_max_protein_gray(foods, total_kcal);
+		} });
+	solvers.push_back({ "exhaustive_fixed", "subsets", { 8, 12, 16, 20, 24 },
+		[](const FoodTable& foods, int total_kcal) {
+			return exhaustive_max_protein_fixed(foods, total_kcal);
+		} });
+	solvers.push_back({ "exhaustive_simd", "subsets", { 8, 12, 16, 20, 24 },
+		[](const FoodTable& foods, int total_kcal) {
+			return exhaustive_max_protein_simd(foods, total_kcal);
+		} });
+	solvers.push_back({ "exhaustive_parallel", "subsets", { 16, 20, 24 },
+		[](const FoodTable& foods, int total_kcal) {
+			return exhaustive_max_protein_parallel(foods, total_kcal);
+		} });
+	solvers.push_back({ "meet_in_middle", "items", { 8, 12, 16, 20, 30, 40, 50 },
+		[](const FoodTable& foods, int total_kcal) {
+			return meet_in_middle_max_protein(foods, total_kcal);
+		} });
+	solvers.push_back({ "branch_and_bound", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return branch_and_bound_max_protein(foods, total_kcal);
+		} });
+	solvers.push_back({ "dynamic", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return dynamic_max_protein(foods, total_kcal);
+		} });
+	solvers.push_back({ "dynamic_low_memory", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return dynamic_max_protein_low_memory(foods, total_kcal);
+		} });
+	solvers.push_back({ "bitset", "items", large,
+		[](const FoodTable& foods, int total_kcal) {
+			return bitset_max_protein(foods, total_kcal);
+		} });
+	std::vector<int> every_size = { 8, 12, 20, 50 };
+	every_size.insert(every_size.end(), large.begin(), large.end());
+	solvers.push_back({ "max_protein", "items", every_size,
+		[](const FoodTable& foods, int total_kcal) {
+			return max_protein(foods, total_kcal);
+		} });
+	return solvers;
+}
+
+int main(int argc, char* argv[]) {
+	int trials = 11, warmup = 2, total_kcal = 2000;
+	bool json = false;
+	std::string only;
+	for (int i = 1; i < argc; i++) {
+		const bool has_value = (i + 1 < argc);
+		if (!std::strcmp(argv[i], "--trials") && has_value)
+			trials = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i], "--warmup") && has_value)
+			warmup = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i], "--kcal") && has_value)
+			total_kcal = std::atoi(argv[++i]);
+		else if (!std::strcmp(argv[i], "--solver") && has_value)
+			only = argv[++i];
+		else if (!std::strcmp(argv[i], "--json"))
+			json = true;
+		else {
+			std::cerr << "usage: " << argv[0]
+				<< " [--trials N] [--warmup N] [--kcal W] [--json] [--solver NAME]"
+				<< std::endl;
+			return 1;
+		}
+	}
+	if (trials < 1 || warmup < 0) {
+		std::cerr << "trials must be positive and warmup non-negative" << std::endl;
+		return 1;
+	}
+
+	auto all_foods = load_usda_abbrev_fast("ABBREV.txt");
+	if (!all_foods) {
+		std::cerr << "could not load ABBREV.txt" << std::endl;
+		return 1;
+	}
+	auto filtered = filter_food_vector(*all_foods, 1, 2500, all_foods->size());
+	const FoodTable every_food(*filtered);
+
+	if (json)
+		std::cout << "[" << std::endl;
+	else
+		std::cout << "solver,n,kcal,trials,median_s,p95_s,p99_s,throughput,unit,protein_g" << std::endl;
+
+	bool first = true;
+	for (const auto& solver : benchmark_solvers(every_food.size())) {
+		if (!only.empty() && solver.name != only)
+			continue;
+		for (int n : solver.sizes) {
+			if (n > int(every_food.size()))
+				continue;
+			IndexVector prefix(n);
+			for (int i = 0; i < n; i++)
+				prefix[i] = i;
+			const FoodTable foods(*select_foods(*filtered, prefix));
+			const BenchmarkResult result = run_benchmark(solver, foods, total_kcal, warmup, trials);
+
+			if (json) {
+				std::cout << (first ? "  " : ", ")
+					<< "{\"solver\": \"" << solver.name << "\""
+					<< ", \"n\": " << n
+					<< ", \"kcal\": " << total_kcal
+					<< ", \"trials\": " << trials
+					<< ", \"median_s\": " << result.median
+					<< ", \"p95_s\": " << result.p95
+					<< ", \"p99_s\": " << result.p99
+					<< ", \"throughput\": " << result.throughput
+					<< ", \"unit\": \"" << solver.unit << "\""
+					<< ", \"protein_g\": " << result.protein_g << "}" << std::endl;
+			}
+			else {
+				std::cout << solver.name << ','
+					<< n << ','
+					<< total_kcal << ','
+					<< trials << ','
+					<< result.median << ','
+					<< result.p95 << ','
+					<< result.p99 << ','
+					<< result.throughput << ','
+					<< solver.unit << ','
+					<< result.protein_g << std::endl;
+			}
+			first = false;
+		}
+	}
+	if (json)
+		std::cout << "]" << std::endl;
+	return 0;
+}
@@ -7,9 +7,34 @@
 //
 //
 #include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <new>
 #include <sstream>
+#include <stdexcept>
+#include <type_traits>
 #include "maxprotein.hh"
 #include "rubrictest.hh"
+
+// Count heap allocations, to check the SolverWorkspace overloads.
+static size_t heap_allocations = 0;
+
+void* operator new(size_t size) {
+  heap_allocations++;
+  if (void* p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
 int main() {
 Rubric rubric;
 
@@ -21,13 +46,147 @@ Rubric rubric;
   assert( all_foods );
 
   auto filtered_foods = filter_food_vector(*all_foods, 1, 2500, all_foods->size());
+
+  // Optimal protein within 2000 kcal for the first n foods of
+  // filtered_foods, for n = 2 through 18.
+  std::vector<int> optimal_protein_totals = {
+    1, 1, 22, 45, 66, 85, 110, 113, 115, 118, 127, 135, 136,
+    141, 149, 149, 151,
+  };
   
+  // The trivial cases every exact solver must get right.
+  auto test_trivial_cases = [&](std::function<std::unique_ptr<FoodVector>(const FoodVector&, int)> solver) {
+    auto soln = solver(trivial_foods, 99);
+    TEST_TRUE("non-null", soln);
+    TEST_TRUE("empty solution", soln->empty());
+
+    soln = solver(trivial_foods, 100);
+    TEST_TRUE("non-null", soln);
+    TEST_EQUAL("banana only", 1, soln->size());
+    TEST_EQUAL("banana only", "banana", (*soln)[0]->description());
+
+    soln = solver(trivial_foods, 150);
+    TEST_TRUE("non-null", soln);
+    TEST_EQUAL("hotdog only", 1, soln->size());
+    TEST_EQUAL("hotdog only", "hotdog", (*soln)[0]->description());
+
+    soln = solver(trivial_foods, 250);
+    TEST_TRUE("non-null", soln);
+    TEST_EQUAL("hotdog and banana", 2, soln->size());
+  };
+
   rubric.criterion("load_usda_abbrev still works", 2,
 		   [&]() {
 		     TEST_TRUE("non-null", all_foods);
 		     TEST_EQUAL("size", 8490, all_foods->size());
 		   });
 
+  rubric.criterion("load_usda_abbrev_fast", 2,
+		   [&]() {
+		     auto fast = load_usda_abbrev_fast("ABBREV.txt");
+		     auto table = load_usda_abbrev_table("ABBREV.txt");
+		     TEST_TRUE("non-null", fast);
+		     TEST_TRUE("non-null", table);
+		     TEST_EQUAL("size", all_foods->size(), fast->size());
+		     TEST_EQUAL("size", all_foods->size(), table->size());
+		     for (size_t i = 0; i < all_foods->size(); i++) {
+		       const Food &expected = *(*all_foods)[i], &actual = *(*fast)[i];
+		       TEST_EQUAL("description", expected.description(), actual.description());
+		       TEST_EQUAL("amount", expected.amount(), actual.amount());
+		       TEST_EQUAL("amount_g", expected.amount_g(), actual.amount_g());
+		       TEST_EQUAL("kcal", expected.kcal(), actual.kcal());
+		       TEST_EQUAL("protein_g", expected.protein_g(), actual.protein_g());
+		       TEST_EQUAL("table description", expected.description(), table->description(i));
+		       TEST_EQUAL("table kcal", expected.kcal(), table->kcal(i));
+		       TEST_EQUAL("table protein_g", expected.protein_g(), table->protein_g(i));
+		     }
+		     TEST_FALSE("missing file", load_usda_abbrev_fast("does-not-exist.txt"));
+
+		     int rounded = 0;
+		     std::string half = "2.5", low = " 0.49", negative = "-1.5", exponent = "1e2", junk = "~x~";
+		     TEST_TRUE("half", parse_rounded(half.data(), half.data() + half.size(), rounded));
+		     TEST_EQUAL("half rounds up", 3, rounded);
+		     TEST_TRUE("low", parse_rounded(low.data(), low.data() + low.size(), rounded));
+		     TEST_EQUAL("low rounds down", 0, rounded);
+		     TEST_TRUE("negative", parse_rounded(negative.data(), negative.data() + negative.size(), rounded));
+		     TEST_EQUAL("negative rounds away from zero", -2, rounded);
+		     TEST_TRUE("exponent", parse_rounded(exponent.data(), exponent.data() + exponent.size(), rounded));
+		     TEST_EQUAL("exponent", 100, rounded);
+		     TEST_FALSE("junk", parse_rounded(junk.data(), junk.data() + junk.size(), rounded));
+		   });
+
+  rubric.criterion("streaming loader", 2,
+		   [&]() {
+		     auto ten = load_usda_abbrev_filtered("ABBREV.txt", 1, 2000, 10),
+		       expected_ten = filter_food_vector(*all_foods, 1, 2000, 10);
+		     TEST_TRUE("non-null", ten);
+		     TEST_EQUAL("total_size", 10, ten->size());
+		     for (size_t i = 0; i < ten->size(); i++) {
+		       TEST_EQUAL("contents", (*expected_ten)[i]->description(), (*ten)[i]->description());
+		     }
+
+		     auto all = load_usda_abbrev_filtered("ABBREV.txt", 1, 2500, all_foods->size());
+		     TEST_TRUE("non-null", all);
+		     TEST_EQUAL("whole file", filtered_foods->size(), all->size());
+		     TEST_EQUAL("whole file", filtered_foods->back()->description(), all->back()->description());
+		     TEST_EQUAL("none", 0, load_usda_abbrev_filtered("ABBREV.txt", 1, 2500, 0)->size());
+		     TEST_FALSE("missing file", load_usda_abbrev_filtered("does-not-exist.txt", 1, 2500, 10));
+
+		     int visited = 0;
+		     TEST_TRUE("early stop", stream_usda_abbrev("ABBREV.txt", [&](const UsdaAbbrevRecord&) {
+			   return ++visited < 5;
+			 }));
+		     TEST_EQUAL("early stop", 5, visited);
+		   });
+
+  rubric.criterion("compiled food database", 2,
+		   [&]() {
+		     const std::string db_path = "maxprotein_test.db";
+		     TEST_TRUE("compile", compile_food_db("ABBREV.txt", db_path));
+		     auto db = load_food_db(db_path, "ABBREV.txt");
+		     TEST_TRUE("non-null", db);
+		     TEST_EQUAL("size", all_foods->size(), db->size());
+		     for (size_t i = 0; i < all_foods->size(); i++) {
+		       const Food& expected = *(*all_foods)[i];
+		       TEST_EQUAL("description", expected.description(), db->description(i));
+		       TEST_EQUAL("amount", expected.amount(), db->amount(i));
+		       TEST_EQUAL("amount_g", expected.amount_g(), db->amount_g(i));
+		       TEST_EQUAL("kcal", expected.kcal(), db->kcal(i));
+		       TEST_EQUAL("protein_g", expected.protein_g(), db->protein_g(i));
+		     }
+		     FoodTable table = db->to_table();
+		     TEST_EQUAL("to_table", all_foods->size(), table.size());
+		     TEST_EQUAL("to_table", (*all_foods)[100]->description(), table.description(100));
+
+		     //Corrupt string offsets and sizes must be rejected, not read
+		     auto patch = [&](size_t position, const void* bytes, size_t size) {
+		       TEST_TRUE("recompile", compile_food_db("ABBREV.txt", db_path));
+		       std::fstream file(db_path, std::ios::in | std::ios::out | std::ios::binary);
+		       file.seekp(position);
+		       file.write(static_cast<const char*>(bytes), size);
+		     };
+		     const size_t offsets_at = sizeof(FoodDbHeader) + 3 * sizeof(int32_t) * all_foods->size();
+		     const uint32_t far_offset = 0xFFFFFF00u;
+		     const uint64_t huge_size = ~uint64_t(0) - 7;
+		     patch(offsets_at + sizeof(uint32_t), &far_offset, sizeof(far_offset));
+		     FoodDatabase corrupt;
+		     TEST_FALSE("offset out of range", corrupt.open(db_path));
+		     patch(offsetof(FoodDbHeader, strings_size), &huge_size, sizeof(huge_size));
+		     TEST_FALSE("strings size overflow", corrupt.open(db_path));
+
+		     std::ofstream(db_path) << "not a database";
+		     auto fallback = load_food_db(db_path, "ABBREV.txt");
+		     TEST_TRUE("invalid file falls back", fallback);
+		     TEST_FALSE("invalid file falls back", fallback->mapped());
+		     TEST_EQUAL("invalid file falls back", all_foods->size(), fallback->size());
+		     std::remove(db_path.c_str());
+
+		     fallback = load_food_db(db_path, "ABBREV.txt");
+		     TEST_TRUE("missing file falls back", fallback);
+		     TEST_EQUAL("missing file falls back", (*all_foods)[0]->description(), fallback->description(0));
+		     TEST_FALSE("nothing to load", load_food_db(db_path, "does-not-exist.txt"));
+		   });
+
   rubric.criterion("filter_food_vector", 2,
 		   [&]() {
 		     auto three = filter_food_vector(*all_foods, 1, 2000, 3),
@@ -43,6 +202,22 @@ Rubric rubric;
 		     }
 		   });
 
+  rubric.criterion("KcalIndex", 2,
+		   [&]() {
+		     KcalIndex index(*all_foods);
+		     TEST_EQUAL("size", all_foods->size(), index.size());
+		     for (int min_kcal : { 0, 1, 100, 500 }) {
+		       for (int max_kcal : { 0, 99, 450, 2500 }) {
+			 for (int total_size : { 0, 3, 25, 100000 }) {
+			   auto expected = filter_food_vector(*all_foods, min_kcal, max_kcal, total_size),
+			     actual = index.filter(min_kcal, max_kcal, total_size);
+			   TEST_TRUE("non-null", actual);
+			   TEST_TRUE("same as filter_food_vector", *expected == *actual);
+			 }
+		       }
+		     }
+		   });
+
   rubric.criterion("greedy_max_protein trivial cases", 2,
 		   [&]() {
 		     auto soln = greedy_max_protein(trivial_foods, 99);
@@ -82,6 +257,56 @@ Rubric rubric;
 		     TEST_EQUAL("2500 kcal solution", 595, protein2500);
 		   });
 
+  rubric.criterion("greedy_max_protein order", 2,
+		   [&]() {
+		     auto soln = greedy_max_protein(*filtered_foods, 2000);
+		     TEST_EQUAL("chosen from the input", soln->size(),
+				food_vector_indices(*filtered_foods, *soln).size());
+		     for (size_t i = 1; i < soln->size(); i++) {
+		       TEST_GE("most protein first", (*soln)[i-1]->protein_g(), (*soln)[i]->protein_g());
+		     }
+
+		     FoodVector ties;
+		     ties.push_back(std::shared_ptr<Food>(new Food("first", "1 each", 10, 100, 5)));
+		     ties.push_back(std::shared_ptr<Food>(new Food("second", "1 each", 10, 100, 5)));
+		     soln = greedy_max_protein(ties, 150);
+		     TEST_EQUAL("one tie", 1, soln->size());
+		     TEST_EQUAL("first index wins ties", "first", (*soln)[0]->description());
+		   });
+
+  rubric.criterion("greedy_max_protein strategies", 4,
+		   [&]() {
+		     auto soln = greedy_max_protein(trivial_foods, 150, GreedyStrategy::DENSITY);
+		     TEST_EQUAL("hotdog is denser", 1, soln->size());
+		     TEST_EQUAL("hotdog is denser", "hotdog", (*soln)[0]->description());
+
+		     FoodVector trap;
+		     trap.push_back(std::shared_ptr<Food>(new Food("dense", "1 each", 10, 10, 2)));
+		     trap.push_back(std::shared_ptr<Food>(new Food("big", "1 each", 100, 100, 10)));
+		     soln = greedy_max_protein(trap, 100, GreedyStrategy::DENSITY);
+		     TEST_EQUAL("density falls for the trap", "dense", (*soln)[0]->description());
+		     soln = greedy_max_protein(trap, 100, GreedyStrategy::BEST_OF_BOTH);
+		     TEST_EQUAL("best of both avoids it", 1, soln->size());
+		     TEST_EQUAL("best of both avoids it", "big", (*soln)[0]->description());
+
+		     for (int budget : { 1500, 2000, 2500 }) {
+		       auto optimal = dynamic_max_protein(*filtered_foods, budget);
+		       int optimal_kcal, optimal_protein;
+		       sum_food_vector(optimal_kcal, optimal_protein, *optimal);
+		       for (auto strategy : { GreedyStrategy::DENSITY, GreedyStrategy::BEST_OF_BOTH }) {
+			 auto greedy = greedy_max_protein(*filtered_foods, budget, strategy);
+			 int kcal, protein;
+			 sum_food_vector(kcal, protein, *greedy);
+			 TEST_LE("within budget", kcal, budget);
+			 TEST_GE("half approximation", 2 * protein, optimal_protein);
+		       }
+		     }
+		     auto density2000 = greedy_max_protein(*filtered_foods, 2000, GreedyStrategy::DENSITY);
+		     int kcal2000, protein2000;
+		     sum_food_vector(kcal2000, protein2000, *density2000);
+		     TEST_EQUAL("2000 kcal density solution", 501, protein2000);
+		   });
+
   rubric.criterion("exhaustive_max_protein trivial cases", 2,
 		   [&]() {
 		     auto soln = exhaustive_max_protein(trivial_foods, 99);
@@ -106,11 +331,6 @@ Rubric rubric;
   rubric.criterion("exhaustive_max_protein correctness", 4,
 		   [&]() {
 
-		     std::vector<int> optimal_protein_totals = {
-		       1, 1, 22, 45, 66, 85, 110, 113, 115, 118, 127, 135, 136,
-		       141, 149, 149, 151,
-		     };
-		     
 		     for (int n = 2; n <= 18; n++) {
 		       int expected_protein = optimal_protein_totals[n-2];
 		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
@@ -127,5 +347,1000 @@ Rubric rubric;
 		     }
 		   });
 
+  rubric.criterion("dynamic_max_protein trivial cases", 2,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return dynamic_max_protein(foods, total_kcal);
+		       });
+		   });
+
+  rubric.criterion("dynamic_max_protein correctness", 4,
+		   [&]() {
+		     for (int n = 2; n <= 18; n++) {
+		       int expected_protein = optimal_protein_totals[n-2];
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       auto solution = dynamic_max_protein(*small_foods, 2000);
+		       TEST_TRUE("non-null", solution);
+		       int actual_kcal, actual_protein;
+		       sum_food_vector(actual_kcal, actual_protein, *solution);
+		       std::stringstream ss;
+		       ss << "dynamic programming n=" << n
+			  << ", expected protein=" << expected_protein
+			  << " but algorithm found=" << actual_protein;
+		       TEST_EQUAL(ss.str(), expected_protein, actual_protein);
+		       TEST_LE("within budget", actual_kcal, 2000);
+		     }
+
+		     auto soln2000 = dynamic_max_protein(*filtered_foods, 2000),
+		       greedy2000 = greedy_max_protein(*filtered_foods, 2000);
+		     TEST_TRUE("non-null", soln2000);
+		     int kcal, protein, greedy_kcal, greedy_protein;
+		     sum_food_vector(kcal, protein, *soln2000);
+		     sum_food_vector(greedy_kcal, greedy_protein, *greedy2000);
+		     TEST_LE("within budget", kcal, 2000);
+		     TEST_GE("at least greedy", protein, greedy_protein);
+		   });
+
+  rubric.criterion("exhaustive_max_protein_gray trivial cases", 2,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return exhaustive_max_protein_gray(foods, total_kcal);
+		       });
+		   });
+
+  rubric.criterion("exhaustive_max_protein_gray correctness", 4,
+		   [&]() {
+		     for (int n = 2; n <= 18; n++) {
+		       int expected_protein = optimal_protein_totals[n-2];
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       auto solution = exhaustive_max_protein_gray(*small_foods, 2000);
+		       TEST_TRUE("non-null", solution);
+		       int actual_kcal, actual_protein;
+		       sum_food_vector(actual_kcal, actual_protein, *solution);
+		       std::stringstream ss;
+		       ss << "gray code exhaustive search n=" << n
+			  << ", expected protein=" << expected_protein
+			  << " but algorithm found=" << actual_protein;
+		       TEST_EQUAL(ss.str(), expected_protein, actual_protein);
+		       TEST_LE("within budget", actual_kcal, 2000);
+		       if (n <= 12) {
+			 auto serial = exhaustive_max_protein(*small_foods, 2000);
+			 TEST_TRUE("same subset as exhaustive_max_protein", *serial == *solution);
+		       }
+		     }
+		   });
+
+  rubric.criterion("meet_in_middle_max_protein trivial cases", 2,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return meet_in_middle_max_protein(foods, total_kcal);
+		       });
+		   });
+
+  rubric.criterion("meet_in_middle_max_protein correctness", 4,
+		   [&]() {
+		     for (int n = 2; n <= 18; n++) {
+		       int expected_protein = optimal_protein_totals[n-2];
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       auto solution = meet_in_middle_max_protein(*small_foods, 2000);
+		       TEST_TRUE("non-null", solution);
+		       int actual_kcal, actual_protein;
+		       sum_food_vector(actual_kcal, actual_protein, *solution);
+		       std::stringstream ss;
+		       ss << "meet in the middle n=" << n
+			  << ", expected protein=" << expected_protein
+			  << " but algorithm found=" << actual_protein;
+		       TEST_EQUAL(ss.str(), expected_protein, actual_protein);
+		       TEST_LE("within budget", actual_kcal, 2000);
+		     }
+
+		     for (int budget : { 500, 2000, 5000 }) {
+		       auto foods40 = filter_food_vector(*filtered_foods, 1, 2000, 40);
+		       auto dynamic = dynamic_max_protein(*foods40, budget),
+			 middle = meet_in_middle_max_protein(*foods40, budget);
+		       int dynamic_kcal, dynamic_protein, middle_kcal, middle_protein;
+		       sum_food_vector(dynamic_kcal, dynamic_protein, *dynamic);
+		       sum_food_vector(middle_kcal, middle_protein, *middle);
+		       TEST_EQUAL("n=40 matches dynamic_max_protein", dynamic_protein, middle_protein);
+		       TEST_LE("within budget", middle_kcal, budget);
+		     }
+		   });
+
+  rubric.criterion("branch_and_bound_max_protein trivial cases", 2,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return branch_and_bound_max_protein(foods, total_kcal);
+		       });
+		   });
+
+  rubric.criterion("branch_and_bound_max_protein correctness", 4,
+		   [&]() {
+		     for (int n = 2; n <= 18; n++) {
+		       int expected_protein = optimal_protein_totals[n-2];
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       bool proven_optimal = false;
+		       auto solution = branch_and_bound_max_protein(*small_foods, 2000, proven_optimal);
+		       TEST_TRUE("non-null", solution);
+		       TEST_TRUE("proven optimal", proven_optimal);
+		       int actual_kcal, actual_protein;
+		       sum_food_vector(actual_kcal, actual_protein, *solution);
+		       std::stringstream ss;
+		       ss << "branch and bound n=" << n
+			  << ", expected protein=" << expected_protein
+			  << " but algorithm found=" << actual_protein;
+		       TEST_EQUAL(ss.str(), expected_protein, actual_protein);
+		       TEST_LE("within budget", actual_kcal, 2000);
+		     }
+
+		     for (int budget : { 1500, 2000, 2500 }) {
+		       bool proven_optimal = false;
+		       auto solution = branch_and_bound_max_protein(*filtered_foods, budget, proven_optimal),
+			 dynamic = dynamic_max_protein(*filtered_foods, budget);
+		       int kcal, protein, dynamic_kcal, dynamic_protein;
+		       sum_food_vector(kcal, protein, *solution);
+		       sum_food_vector(dynamic_kcal, dynamic_protein, *dynamic);
+		       TEST_TRUE("proven optimal", proven_optimal);
+		       TEST_EQUAL("all foods matches dynamic_max_protein", dynamic_protein, protein);
+		       TEST_LE("within budget", kcal, budget);
+		     }
+		   });
+
+  rubric.criterion("branch_and_bound_max_protein limits", 2,
+		   [&]() {
+		     bool proven_optimal = true;
+		     auto solution = branch_and_bound_max_protein(*filtered_foods, 2000, proven_optimal, 1);
+		     TEST_FALSE("node limit reached", proven_optimal);
+		     int kcal, protein;
+		     sum_food_vector(kcal, protein, *solution);
+		     TEST_LE("within budget", kcal, 2000);
+		     TEST_GE("at least the greedy seed", protein, 476);
+		   });
+
+  rubric.criterion("fptas_max_protein trivial cases", 2,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return fptas_max_protein(foods, total_kcal, 0.1);
+		       });
+		   });
+
+  rubric.criterion("fptas_max_protein approximation", 4,
+		   [&]() {
+		     for (int budget : { 2000, 14000 }) {
+		       auto optimal = dynamic_max_protein(*filtered_foods, budget);
+		       int optimal_kcal, optimal_protein;
+		       sum_food_vector(optimal_kcal, optimal_protein, *optimal);
+		       for (double epsilon : { 0.05, 0.5 }) {
+			 auto solution = fptas_max_protein(*filtered_foods, budget, epsilon);
+			 int kcal, protein;
+			 sum_food_vector(kcal, protein, *solution);
+			 TEST_LE("within budget", kcal, budget);
+			 TEST_GE("within epsilon", protein, (1 - epsilon) * optimal_protein);
+		       }
+		     }
+
+		     //Large protein values, so that protein actually gets scaled
+		     FoodVector heavy;
+		     for (int i = 0; i < 40; i++) {
+		       heavy.push_back(std::shared_ptr<Food>(new Food("heavy", "1 each", 100,
+								   50 + (i * 37) % 200,
+								   5000 + (i * 7919) % 20000)));
+		     }
+		     auto optimal = dynamic_max_protein(heavy, 1000);
+		     int optimal_kcal, optimal_protein;
+		     sum_food_vector(optimal_kcal, optimal_protein, *optimal);
+		     for (double epsilon : { 0.01, 0.2, 0.9 }) {
+		       auto solution = fptas_max_protein(heavy, 1000, epsilon);
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *solution);
+		       TEST_LE("within budget", kcal, 1000);
+		       TEST_GE("within epsilon", protein, (1 - epsilon) * optimal_protein);
+		     }
+		   });
+
+  rubric.criterion("exhaustive_max_protein_parallel trivial cases", 2,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return exhaustive_max_protein_parallel(foods, total_kcal, 2);
+		       });
+		   });
+
+  rubric.criterion("exhaustive_max_protein_parallel correctness", 4,
+		   [&]() {
+		     for (int n = 2; n <= 18; n++) {
+		       int expected_protein = optimal_protein_totals[n-2];
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       auto solution = exhaustive_max_protein_parallel(*small_foods, 2000, 4);
+		       TEST_TRUE("non-null", solution);
+		       int actual_kcal, actual_protein;
+		       sum_food_vector(actual_kcal, actual_protein, *solution);
+		       std::stringstream ss;
+		       ss << "parallel exhaustive search n=" << n
+			  << ", expected protein=" << expected_protein
+			  << " but algorithm found=" << actual_protein;
+		       TEST_EQUAL(ss.str(), expected_protein, actual_protein);
+		       if (n <= 12) {
+			 auto serial = exhaustive_max_protein(*small_foods, 2000);
+			 for (unsigned threads : { 1, 3, 8 }) {
+			   auto parallel = exhaustive_max_protein_parallel(*small_foods, 2000, threads);
+			   TEST_TRUE("same subset as exhaustive_max_protein", *serial == *parallel);
+			 }
+		       }
+		     }
+		   });
+
+  rubric.criterion("FoodTable", 4,
+		   [&]() {
+		     FoodTable table(*filtered_foods);
+		     TEST_EQUAL("size", filtered_foods->size(), table.size());
+		     TEST_EQUAL("description", "BUTTER,WITH SALT", table.description(0));
+		     TEST_EQUAL("amount", (*filtered_foods)[9]->amount(), table.amount(9));
+		     TEST_EQUAL("amount_g", (*filtered_foods)[9]->amount_g(), table.amount_g(9));
+		     TEST_EQUAL("kcal", (*filtered_foods)[9]->kcal(), table.kcal(9));
+		     TEST_EQUAL("protein_g", (*filtered_foods)[9]->protein_g(), table.protein_g(9));
+
+		     FoodTable numbers = FoodTable::numbers(*filtered_foods);
+		     TEST_EQUAL("numbers size", table.size(), numbers.size());
+		     TEST_TRUE("numbers columns", std::equal(table.kcal_data(), table.kcal_data() + table.size(),
+							     numbers.kcal_data()) &&
+			       std::equal(table.protein_g_data(), table.protein_g_data() + table.size(),
+					  numbers.protein_g_data()));
+		     TEST_TRUE("no strings", numbers.strings().empty() && numbers.description(9).empty());
+		     TEST_TRUE("same answer", dynamic_max_protein(numbers, 2000) == dynamic_max_protein(table, 2000));
+
+		     auto round_trip = table.to_food_vector();
+		     TEST_EQUAL("round trip size", filtered_foods->size(), round_trip->size());
+		     for (size_t i = 0; i < round_trip->size(); i += 97) {
+		       TEST_EQUAL("round trip", (*filtered_foods)[i]->description(), (*round_trip)[i]->description());
+		       TEST_EQUAL("round trip", (*filtered_foods)[i]->amount(), (*round_trip)[i]->amount());
+		       TEST_EQUAL("round trip", (*filtered_foods)[i]->kcal(), (*round_trip)[i]->kcal());
+		     }
+
+		     auto same_foods = [&](const FoodVector& foods, const IndexVector& indices) {
+		       return *select_foods(*filtered_foods, indices) == foods;
+		     };
+		     TEST_TRUE("greedy", same_foods(*greedy_max_protein(*filtered_foods, 2000),
+						    greedy_max_protein(table, 2000)));
+		     TEST_TRUE("dynamic", same_foods(*dynamic_max_protein(*filtered_foods, 2000),
+						     dynamic_max_protein(table, 2000)));
+		     TEST_TRUE("branch and bound", same_foods(*branch_and_bound_max_protein(*filtered_foods, 2000),
+							      branch_and_bound_max_protein(table, 2000)));
+		     TEST_TRUE("fptas", same_foods(*fptas_max_protein(*filtered_foods, 2000, 0.1),
+						   fptas_max_protein(table, 2000, 0.1)));
+
+		     auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, 12);
+		     FoodTable small_table(*small_foods);
+		     auto serial = exhaustive_max_protein(*small_foods, 2000);
+		     TEST_TRUE("exhaustive", *select_foods(*small_foods, exhaustive_max_protein(small_table, 2000)) == *serial);
+		     TEST_TRUE("gray", *select_foods(*small_foods, exhaustive_max_protein_gray(small_table, 2000)) == *serial);
+		     TEST_TRUE("parallel", *select_foods(*small_foods, exhaustive_max_protein_parallel(small_table, 2000, 2)) == *serial);
+		     auto middle = select_foods(*small_foods, meet_in_middle_max_protein(small_table, 2000));
+		     int serial_kcal, serial_protein, middle_kcal, middle_protein;
+		     sum_food_vector(serial_kcal, serial_protein, *serial);
+		     sum_food_vector(middle_kcal, middle_protein, *middle);
+		     TEST_EQUAL("meet in the middle", serial_protein, middle_protein);
+		   });
+
+  rubric.criterion("MaxProteinCache", 4,
+		   [&]() {
+		     MaxProteinCache cache(2);
+		     auto expected = [&](const FoodVector& foods, int budget) {
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *dynamic_max_protein(foods, budget));
+		       return protein;
+		     };
+		     auto check = [&](const FoodVector& foods, int budget) {
+		       auto solution = cache.solve(foods, budget);
+		       TEST_EQUAL("chosen from the input", solution->size(),
+				  food_vector_indices(foods, *solution).size());
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *solution);
+		       TEST_LE("within budget", kcal, budget);
+		       TEST_EQUAL("same protein as dynamic_max_protein", expected(foods, budget), protein);
+		     };
+
+		     check(*filtered_foods, 2500);
+		     TEST_EQUAL("first query misses", 1, cache.misses());
+		     check(*filtered_foods, 2500);
+		     check(*filtered_foods, 2000);
+		     check(*filtered_foods, 1500);
+		     TEST_EQUAL("smaller budgets hit", 3, cache.hits());
+
+		     FoodVector reversed(filtered_foods->rbegin(), filtered_foods->rend());
+		     check(reversed, 2000);
+		     TEST_EQUAL("any order hits", 4, cache.hits());
+
+		     //More budgets than an entry keeps selections for
+		     auto some_foods = filter_food_vector(*filtered_foods, 1, 2000, 300);
+		     MaxProteinCache budgets(1);
+		     for (int round = 0; round < 2; round++)
+		       for (size_t budget = 0; budget < 2 * MaxProteinCache::MAX_SELECTIONS; budget++) {
+			 auto solution = budgets.solve(*some_foods, 2000 - int(budget) * 50);
+			 int kcal, protein;
+			 sum_food_vector(kcal, protein, *solution);
+			 TEST_EQUAL("capped selections stay exact",
+				    expected(*some_foods, 2000 - int(budget) * 50), protein);
+		       }
+		     TEST_EQUAL("one solve", 1, budgets.misses());
+
+		     check(*filtered_foods, 3000);
+		     TEST_EQUAL("larger budget misses", 2, cache.misses());
+		     TEST_EQUAL("replaces entry", 1, cache.size());
+
+		     auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, 18),
+		       tiny_foods = filter_food_vector(*filtered_foods, 1, 2000, 5);
+		     check(*small_foods, 2000);
+		     check(*tiny_foods, 2000);
+		     TEST_EQUAL("bounded", 2, cache.size());
+		     check(*filtered_foods, 2000);
+		     TEST_EQUAL("least recently used was evicted", 5, cache.misses());
+		     TEST_EQUAL("trivial", 0, cache.solve(trivial_foods, 99)->size());
+		   });
+
+  rubric.criterion("batch queries", 4,
+		   [&]() {
+		     std::vector<int> budgets = { 2500, 99, 1500, 2000, 100, 250, -1 };
+		     for (auto strategy : { GreedyStrategy::PROTEIN, GreedyStrategy::DENSITY,
+			   GreedyStrategy::BEST_OF_BOTH }) {
+		       auto batch = greedy_max_protein_batch(*filtered_foods, budgets, strategy);
+		       TEST_EQUAL("one result per budget", budgets.size(), batch.size());
+		       for (size_t b = 0; b < budgets.size(); b++) {
+			 auto single = greedy_max_protein(*filtered_foods, budgets[b], strategy);
+			 TEST_TRUE("same as greedy_max_protein", *single == *batch[b]);
+		       }
+		     }
+
+		     auto batch = dynamic_max_protein_batch(*filtered_foods, budgets);
+		     TEST_EQUAL("one result per budget", budgets.size(), batch.size());
+		     for (size_t b = 0; b < budgets.size(); b++) {
+		       auto single = dynamic_max_protein(*filtered_foods, budgets[b]);
+		       int single_kcal, single_protein, batch_kcal, batch_protein;
+		       sum_food_vector(single_kcal, single_protein, *single);
+		       sum_food_vector(batch_kcal, batch_protein, *batch[b]);
+		       TEST_EQUAL("same protein as dynamic_max_protein", single_protein, batch_protein);
+		       TEST_LE("within budget", batch_kcal, std::max(budgets[b], 0));
+		     }
+		     TEST_TRUE("no budgets", dynamic_max_protein_batch(*filtered_foods, std::vector<int>()).empty());
+		   });
+
+  rubric.criterion("exhaustive_max_protein_simd", 4,
+		   [&]() {
+		     for (auto level : { SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512 }) {
+		       test_trivial_cases([=](const FoodVector& foods, int total_kcal) {
+			   return exhaustive_max_protein_simd(foods, total_kcal, level);
+			 });
+		       for (int n = 2; n <= 18; n++) {
+			 auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+			 auto solution = exhaustive_max_protein_simd(*small_foods, 2000, level);
+			 int actual_kcal, actual_protein;
+			 sum_food_vector(actual_kcal, actual_protein, *solution);
+			 TEST_EQUAL("optimal protein", optimal_protein_totals[n-2], actual_protein);
+			 TEST_LE("within budget", actual_kcal, 2000);
+			 if (n <= 12) {
+			   for (int budget : { 0, 300, 2000, 100000 }) {
+			     auto serial = exhaustive_max_protein(*small_foods, budget);
+			     TEST_TRUE("same subset as exhaustive_max_protein",
+				       *serial == *exhaustive_max_protein_simd(*small_foods, budget, level));
+			   }
+			 }
+		       }
+		     }
+		   });
+
+  rubric.criterion("FoodReduction", 4,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return exhaustive_max_protein_reduced(foods, total_kcal);
+		       });
+		     for (int n = 2; n <= 20; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       for (int budget : { 0, 300, 2000, 100000 }) {
+			 int expected_kcal, expected_protein, actual_kcal, actual_protein;
+			 sum_food_vector(expected_kcal, expected_protein,
+					 *dynamic_max_protein(*small_foods, budget));
+			 sum_food_vector(actual_kcal, actual_protein,
+					 *exhaustive_max_protein_reduced(*small_foods, budget));
+			 TEST_EQUAL("reduced exhaustive protein", expected_protein, actual_protein);
+			 TEST_LE("reduced exhaustive within budget", actual_kcal, budget);
+		       }
+		     }
+
+		     FoodTable table(*filtered_foods);
+		     FoodReduction reduction(table, 2000);
+		     TEST_TRUE("reduction removes foods", reduction.removed(table) > 0);
+		     for (size_t i = 0; i < reduction.foods().size(); i++) {
+		       TEST_TRUE("no zero-protein foods", reduction.foods().protein_g(i) > 0);
+		       TEST_LE("no over-budget foods", reduction.foods().kcal(i), 2000);
+		     }
+		     auto solution = reduced_max_protein(*filtered_foods, 2000,
+							 [](const FoodTable& foods, int total_kcal) {
+							   return dynamic_max_protein(foods, total_kcal);
+							 });
+		     int kcal, protein;
+		     sum_food_vector(kcal, protein, *solution);
+		     TEST_EQUAL("reduced dynamic protein", 501, protein);
+		     TEST_LE("reduced dynamic within budget", kcal, 2000);
+		   });
+
+  rubric.criterion("SolverWorkspace", 4,
+		   [&]() {
+		     FoodTable table(*filtered_foods);
+		     FoodTable small_table(*filter_food_vector(*filtered_foods, 1, 2000, 16));
+		     SolverWorkspace workspace;
+		     int out[64];
+		     for (int budget : { -1, 0, 300, 2000 }) {
+		       for (auto strategy : { GreedyStrategy::PROTEIN, GreedyStrategy::DENSITY,
+					      GreedyStrategy::BEST_OF_BOTH }) {
+			 auto expected = greedy_max_protein(table, budget, strategy);
+			 size_t count = greedy_max_protein(table, budget, workspace, out, 64, strategy);
+			 TEST_TRUE("greedy matches", IndexVector(out, out + count) == expected);
+		       }
+		       auto expected = dynamic_max_protein(table, budget);
+		       size_t count = dynamic_max_protein(table, budget, workspace, out, 64);
+		       TEST_TRUE("dynamic matches", IndexVector(out, out + count) == expected);
+		       expected = exhaustive_max_protein(small_table, budget);
+		       count = exhaustive_max_protein(small_table, budget, workspace, out, 64);
+		       TEST_TRUE("exhaustive matches", IndexVector(out, out + count) == expected);
+		     }
+
+		     TEST_EQUAL("count beyond capacity",
+				dynamic_max_protein(table, 2000).size(),
+				dynamic_max_protein(table, 2000, workspace, out, 1));
+		     TEST_EQUAL("null buffer", dynamic_max_protein(table, 2000).size(),
+				dynamic_max_protein(table, 2000, workspace, nullptr, 0));
+
+		     //Warmed up at the largest budget, solves allocate nothing
+		     const size_t before = heap_allocations;
+		     for (int budget : { 300, 1000, 2000 }) {
+		       greedy_max_protein(table, budget, workspace, out, 64, GreedyStrategy::BEST_OF_BOTH);
+		       dynamic_max_protein(table, budget, workspace, out, 64);
+		       exhaustive_max_protein(small_table, budget, workspace, out, 64);
+		     }
+		     TEST_EQUAL("no allocations after warm-up", size_t(0), heap_allocations - before);
+		   });
+
+  rubric.criterion("anytime_max_protein", 4,
+		   [&]() {
+		     bool proven_optimal;
+		     test_trivial_cases([&](const FoodVector& foods, int total_kcal) {
+			 return anytime_max_protein(foods, total_kcal, std::chrono::seconds(1), proven_optimal);
+		       });
+
+		     std::vector<int> reported;
+		     IndexVector last;
+		     auto record = [&](const IndexVector& foods, int protein_g) {
+		       reported.push_back(protein_g);
+		       last = foods;
+		     };
+		     FoodTable table(*filtered_foods);
+		     auto solution = anytime_max_protein(table, 1500, std::chrono::seconds(1),
+							 proven_optimal, record);
+		     TEST_TRUE("proven optimal", proven_optimal);
+		     TEST_FALSE("reported incumbents", reported.empty());
+		     TEST_TRUE("last report is the answer", last == solution);
+		     TEST_EQUAL("optimal protein", 385, reported.back());
+		     for (size_t i = 1; i < reported.size(); i++)
+		       TEST_TRUE("reports improve", reported[i] > reported[i-1]);
+		     TEST_LT("greedy answer first", reported.front(), 385);
+
+		     reported.clear();
+		     anytime_max_protein(table, 1500, std::chrono::milliseconds(0),
+					 proven_optimal, record);
+		     TEST_FALSE("no time, not proven", proven_optimal);
+		     TEST_EQUAL("greedy answer reported", size_t(1), reported.size());
+		     TEST_EQUAL("greedy answer", reported.front(), reported.back());
+
+		     reported.clear();
+		     auto limited = anytime_max_protein(*filtered_foods, 1500, std::chrono::seconds(1),
+							proven_optimal, record, 1);
+		     int kcal, protein, greedy_kcal, greedy_protein;
+		     sum_food_vector(kcal, protein, *limited);
+		     sum_food_vector(greedy_kcal, greedy_protein,
+				     *greedy_max_protein(*filtered_foods, 1500, GreedyStrategy::BEST_OF_BOTH));
+		     TEST_FALSE("node limit, not proven", proven_optimal);
+		     TEST_LE("within budget", kcal, 1500);
+		     TEST_FALSE("reported incumbents", reported.empty());
+		     TEST_LE("no worse than its first incumbent", reported.front(), protein);
+		     TEST_LE("no worse than greedy", greedy_protein, protein);
+		   });
+
+  rubric.criterion("local_search_max_protein", 4,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return local_search_max_protein(foods, total_kcal);
+		       });
+		     FoodTable table(*filtered_foods);
+		     for (int budget : { 0, 300, 1500, 2000, 3000 }) {
+		       int greedy_protein = 0, search_protein = 0, search_kcal = 0, optimal_protein = 0;
+		       for (int i : greedy_max_protein(table, budget, GreedyStrategy::BEST_OF_BOTH))
+			 greedy_protein += table.protein_g(i);
+		       for (int i : local_search_max_protein(table, budget)) {
+			 search_kcal += table.kcal(i);
+			 search_protein += table.protein_g(i);
+		       }
+		       for (int i : dynamic_max_protein(table, budget))
+			 optimal_protein += table.protein_g(i);
+		       TEST_LE("within budget", search_kcal, budget);
+		       TEST_LE("no worse than greedy", greedy_protein, search_protein);
+		       TEST_LE("no better than optimal", search_protein, optimal_protein);
+		     }
+		     int improved_protein = 0;
+		     for (int i : local_search_improve(table, 3000,
+						   greedy_max_protein(table, 3000, GreedyStrategy::DENSITY)))
+		       improved_protein += table.protein_g(i);
+		     TEST_EQUAL("closes the gap at 3000 kcal", 725, improved_protein);
+
+		     int kcal = 0;
+		     for (int i : local_search_improve(table, 2000, IndexVector()))
+		       kcal += table.kcal(i);
+		     TEST_LE("from nothing, within budget", kcal, 2000);
+		     TEST_LT("from nothing, adds foods", 0, kcal);
+		   });
+
+  rubric.criterion("max_protein", 4,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return max_protein(foods, total_kcal);
+		       });
+
+		     FoodTable table(*filtered_foods);
+		     FoodTable tiny(*filter_food_vector(*filtered_foods, 1, 2000, 10));
+		     FoodTable small(*filter_food_vector(*filtered_foods, 1, 2000, 40));
+		     TEST_TRUE("tiny is exhaustive",
+			       choose_solver(tiny, 2000) == SolverEngine::EXHAUSTIVE);
+		     TEST_TRUE("small is meet in the middle",
+			       choose_solver(small, 2000) == SolverEngine::MEET_IN_MIDDLE);
+		     TEST_TRUE("large is dynamic",
+			       choose_solver(table, 2000) == SolverEngine::DYNAMIC);
+
+		     SolverOptions options;
+		     options.dynamic_max_bytes = 1024;
+		     TEST_TRUE("over the memory cap is branch and bound",
+			       choose_solver(table, 2000, options) == SolverEngine::BRANCH_AND_BOUND);
+		     options.time_limit = 0.05;
+		     TEST_TRUE("deadline is anytime",
+			       choose_solver(table, 2000, options) == SolverEngine::ANYTIME);
+		     options.exhaustive_max_n = 40;
+		     TEST_TRUE("thresholds override",
+			       choose_solver(small, 2000, options) == SolverEngine::EXHAUSTIVE);
+		     options.engine = SolverEngine::GREEDY;
+		     TEST_TRUE("explicit engine", choose_solver(tiny, 2000, options) == SolverEngine::GREEDY);
+
+		     for (const FoodTable* foods : { &tiny, &small, &table }) {
+		       for (int budget : { 0, 300, 2000 }) {
+			 int expected = 0, actual = 0, kcal = 0;
+			 for (int i : dynamic_max_protein(*foods, budget))
+			   expected += foods->protein_g(i);
+			 for (int i : max_protein(*foods, budget)) {
+			   actual += foods->protein_g(i);
+			   kcal += foods->kcal(i);
+			 }
+			 TEST_EQUAL("optimal protein", expected, actual);
+			 TEST_LE("within budget", kcal, budget);
+		       }
+		     }
+
+		     SolverOptions dynamic_only;
+		     dynamic_only.branch_and_bound_node_limit = 0;
+		     int protein = 0;
+		     for (int i : max_protein(table, 2000, dynamic_only))
+		       protein += table.protein_g(i);
+		     TEST_EQUAL("dynamic without branch and bound", 501, protein);
+		   });
+
+  rubric.criterion("SolveStats", 4,
+		   [&]() {
+		     TEST_TRUE("NullStats is empty", std::is_empty<NullStats>::value);
+		     FoodTable table(*filtered_foods);
+
+		     CountingStats stats;
+		     stats.begin_phase();
+		     auto loaded = load_usda_abbrev_table("ABBREV.txt");
+		     stats.end_phase(StatsPhase::LOAD);
+		     TEST_TRUE("loaded", bool(loaded));
+		     TEST_LE("load time", 0.0, stats.load_seconds);
+
+		     auto dynamic = dynamic_max_protein(table, 2000, stats);
+		     TEST_TRUE("same answer", dynamic == dynamic_max_protein(table, 2000));
+		     TEST_LT("cells touched", uint64_t(0), stats.dp_cells);
+		     TEST_LE("cells within table", stats.dp_cells, uint64_t(table.size()) * 2001);
+		     TEST_LE("peak scratch holds choice bits",
+			     size_t(8) * (2000 / 64 + 1), stats.peak_scratch_bytes);
+		     TEST_EQUAL("protein", 501, stats.protein_g);
+		     TEST_LE("LP bound", 501.0, stats.lp_bound);
+		     TEST_TRUE("small gap", stats.gap >= 0 && stats.gap < 0.01);
+		     TEST_LE("solve time", 0.0, stats.solve_seconds);
+
+		     stats.reset();
+		     bool proven_optimal;
+		     auto bnb = branch_and_bound_max_protein(table, 2000, proven_optimal, stats);
+		     TEST_TRUE("proven optimal", proven_optimal);
+		     TEST_TRUE("same answer", bnb == branch_and_bound_max_protein(table, 2000));
+		     TEST_LT("nodes visited", uint64_t(0), stats.visited);
+		     TEST_LE("nodes pruned", stats.pruned, stats.visited);
+		     TEST_EQUAL("protein", 501, stats.protein_g);
+
+		     stats.reset();
+		     FoodTable small_table(*filter_food_vector(*filtered_foods, 1, 2000, 12));
+		     exhaustive_max_protein_gray(small_table, 2000, stats);
+		     TEST_EQUAL("subsets visited", uint64_t(4095), stats.visited);
+		     TEST_EQUAL("protein", optimal_protein_totals[10], stats.protein_g);
+
+		     stats.reset();
+		     NullStats none;
+		     TEST_TRUE("max_protein same answer",
+			       max_protein(table, 2000, SolverOptions(), stats) ==
+			       max_protein(table, 2000, SolverOptions(), none));
+		     TEST_EQUAL("max_protein protein", 501, stats.protein_g);
+		   });
+
+  rubric.criterion("exhaustive_max_protein_fixed", 4,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return exhaustive_max_protein_fixed(foods, total_kcal);
+		       });
+		     for (int n = 1; n <= 16; n++) {
+		       FoodTable small_table(*filter_food_vector(*filtered_foods, 1, 2000, n));
+		       for (int budget : { 0, 300, 2000, 100000 }) {
+			 TEST_TRUE("same subset as exhaustive_max_protein",
+				   exhaustive_max_protein(small_table, budget) ==
+				   exhaustive_max_protein_fixed(small_table, budget));
+		       }
+		     }
+		     for (int n : { 18, 20, 26 }) {
+		       FoodTable small_table(*filter_food_vector(*filtered_foods, 1, 2000, n));
+		       TEST_TRUE("same subset as exhaustive_max_protein_simd",
+				 exhaustive_max_protein_simd(small_table, 2000) ==
+				 exhaustive_max_protein_fixed(small_table, 2000));
+		     }
+		   });
+
+  rubric.criterion("bitset_max_protein", 4,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return bitset_max_protein(foods, total_kcal);
+		       });
+		     for (int n = 2; n <= 18; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *bitset_max_protein(*small_foods, 2000));
+		       TEST_EQUAL("optimal protein", optimal_protein_totals[n-2], protein);
+		       TEST_LE("within budget", kcal, 2000);
+		     }
+		     FoodTable table(*filtered_foods);
+		     SolverOptions options;
+		     options.engine = SolverEngine::BITSET;
+		     for (int budget : { 0, 63, 64, 300, 2000 }) {
+		       int expected = 0, actual = 0, kcal = 0;
+		       for (int i : dynamic_max_protein(table, budget))
+			 expected += table.protein_g(i);
+		       IndexVector selection = max_protein(table, budget, options);
+		       for (int i : selection) {
+			 actual += table.protein_g(i);
+			 kcal += table.kcal(i);
+		       }
+		       TEST_EQUAL("optimal protein", expected, actual);
+		       TEST_LE("within budget", kcal, budget);
+		       TEST_TRUE("distinct foods",
+				 std::adjacent_find(selection.begin(), selection.end()) == selection.end());
+		     }
+		   });
+
+  rubric.criterion("dynamic_max_protein_low_memory", 4,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return dynamic_max_protein_low_memory(foods, total_kcal);
+		       });
+		     for (int n = 2; n <= 18; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *dynamic_max_protein_low_memory(*small_foods, 2000));
+		       TEST_EQUAL("optimal protein", optimal_protein_totals[n-2], protein);
+		       TEST_LE("within budget", kcal, 2000);
+		     }
+		     FoodTable table(*filtered_foods);
+		     for (int budget : { 0, 300, 2000, 14000 }) {
+		       CountingStats lean, full;
+		       IndexVector selection = dynamic_max_protein_low_memory(table, budget, lean);
+		       dynamic_max_protein(table, budget, full);
+		       int kcal = 0;
+		       for (int i : selection)
+			 kcal += table.kcal(i);
+		       TEST_EQUAL("optimal protein", full.protein_g, lean.protein_g);
+		       TEST_LE("within budget", kcal, budget);
+		       TEST_TRUE("distinct foods",
+				 std::adjacent_find(selection.begin(), selection.end()) == selection.end());
+		       if (budget >= 2000)
+			 TEST_LT("far less scratch memory",
+				 10 * lean.peak_scratch_bytes, full.peak_scratch_bytes);
+		     }
+		     //Budgets whose single row of choice bits is over the table limit
+		     for (int n = 1; n <= 3; n++) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2500, n);
+		       int kcal, protein, expected_kcal, expected_protein;
+		       sum_food_vector(kcal, protein, *dynamic_max_protein_low_memory(*small_foods, 300000));
+		       sum_food_vector(expected_kcal, expected_protein, *small_foods);
+		       TEST_EQUAL("huge budget takes every food", expected_protein, protein);
+		     }
+		     //Cells counted by hand: at the top, 300000 - kcal + 1 for each
+		     //food; the budget all goes to {A, B}, which splits again and
+		     //adds its two foods' cells; {C, D} gets budget 0, which fits
+		     //neither and touches no cells
+		     FoodVector four;
+		     four.push_back(std::shared_ptr<Food>(new Food("A", "1", 1, 200000, 20)));
+		     four.push_back(std::shared_ptr<Food>(new Food("B", "1", 1, 100000, 5)));
+		     four.push_back(std::shared_ptr<Food>(new Food("C", "1", 1, 120000, 12)));
+		     four.push_back(std::shared_ptr<Food>(new Food("D", "1", 1, 250000, 1)));
+		     CountingStats cells;
+		     dynamic_max_protein_low_memory(FoodTable(four), 300000, cells);
+		     TEST_EQUAL("recursive protein", 25, cells.protein_g);
+		     TEST_EQUAL("recursive cells",
+				uint64_t(100001 + 200001 + 180001 + 50001 + 100001 + 200001),
+				cells.dp_cells);
+
+		     SolverOptions options;
+		     options.engine = SolverEngine::DYNAMIC_LOW_MEMORY;
+		     TEST_TRUE("engine", max_protein(table, 2000, options) ==
+			       dynamic_max_protein_low_memory(table, 2000));
+		   });
+
+  rubric.criterion("constrained_max_protein", 4,
+		   [&]() {
+		     std::vector<Nutrient> keep = { Nutrient::FAT, Nutrient::SODIUM, Nutrient::CHOLESTEROL };
+		     auto nutrient_foods = load_usda_abbrev("ABBREV.txt", keep);
+		     TEST_TRUE("loaded", bool(nutrient_foods));
+		     TEST_EQUAL("same foods", all_foods->size(), nutrient_foods->size());
+		     const Food& butter = *nutrient_foods->front();
+		     TEST_EQUAL("butter fat", 81, butter.nutrient(Nutrient::FAT));
+		     TEST_EQUAL("butter sodium", 643, butter.nutrient(Nutrient::SODIUM));
+		     TEST_EQUAL("butter cholesterol", 215, butter.nutrient(Nutrient::CHOLESTEROL));
+		     TEST_FALSE("carbohydrate not kept", butter.has_nutrient(Nutrient::CARBOHYDRATE));
+		     TEST_TRUE("no nutrients by default", all_foods->front()->nutrients().empty());
+
+		     auto foods = filter_food_vector(*nutrient_foods, 1, 2500, nutrient_foods->size());
+
+		     //Compare with brute force on small inputs
+		     for (int n : { 6, 12, 16 }) {
+		       auto small_foods = filter_food_vector(*foods, 1, 2500, n);
+		       for (int sodium : { 0, 300, 1500, 100000 }) {
+			 std::vector<NutrientLimit> limits = { { Nutrient::SODIUM, sodium },
+							       { Nutrient::FAT, 50 } };
+			 int expected = 0;
+			 for (uint64_t mask = 0; mask < (uint64_t(1) << n); mask++) {
+			   int kcal = 0, protein = 0, salt = 0, fat = 0;
+			   bool known = true;
+			   for (int i = 0; i < n; i++) {
+			     if ((mask >> i) & 1) {
+			       const Food& food = *(*small_foods)[i];
+			       known = known && food.has_nutrient(Nutrient::SODIUM) &&
+				 food.has_nutrient(Nutrient::FAT);
+			       kcal += food.kcal();
+			       protein += food.protein_g();
+			       salt += known ? food.nutrient(Nutrient::SODIUM) : 0;
+			       fat += known ? food.nutrient(Nutrient::FAT) : 0;
+			     }
+			   }
+			   if (known && kcal <= 2000 && salt <= sodium && fat <= 50)
+			     expected = std::max(expected, protein);
+			 }
+			 bool proven_optimal;
+			 IndexVector selection = constrained_max_protein(*small_foods, 2000, limits, proven_optimal);
+			 int protein = 0;
+			 for (int i : selection)
+			   protein += (*small_foods)[i]->protein_g();
+			 TEST_TRUE("proven optimal", proven_optimal);
+			 TEST_EQUAL("optimal protein", expected, protein);
+		       }
+		     }
+
+		     std::vector<NutrientLimit> unlimited;
+		     int kcal, protein;
+		     sum_food_vector(kcal, protein, *constrained_max_protein(*foods, 2000, unlimited));
+		     TEST_EQUAL("no limits", 501, protein);
+
+		     for (int sodium : { 2300, 500 }) {
+		       std::vector<NutrientLimit> limits = { { Nutrient::SODIUM, sodium } };
+		       bool proven_optimal;
+		       IndexVector selection = constrained_max_protein(*foods, 2000, limits,
+								       proven_optimal, 1000000);
+		       int salt = 0, total_kcal = 0;
+		       for (int i : selection) {
+			 salt += (*foods)[i]->nutrient(Nutrient::SODIUM);
+			 total_kcal += (*foods)[i]->kcal();
+		       }
+		       TEST_LE("sodium limit", salt, sodium);
+		       TEST_LE("kcal limit", total_kcal, 2000);
+		       if (sodium == 2300)
+			 TEST_TRUE("proven optimal", proven_optimal);
+		     }
+		   });
+
+  rubric.criterion("bounded_max_protein", 4,
+		   [&]() {
+		     test_trivial_cases([](const FoodVector& foods, int total_kcal) {
+			 return bounded_max_protein(foods, total_kcal);
+		       });
+		     TEST_EQUAL("one serving by default", 1, all_foods->front()->max_servings());
+
+		     //Compare with 0/1 dynamic programming over one copy per serving
+		     for (int n : { 5, 20, 200 }) {
+		       auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, n);
+		       FoodVector servings_foods, copies;
+		       for (int i = 0; i < n; i++) {
+			 const Food& food = *(*small_foods)[i];
+			 const int count = 1 + i % 4;
+			 std::shared_ptr<Food> portion(new Food(food.description(), food.amount(),
+								food.amount_g(), food.kcal(),
+								food.protein_g(), food.nutrients(),
+								count));
+			 servings_foods.push_back(portion);
+			 copies.insert(copies.end(), count, portion);
+		       }
+		       for (int budget : { 0, 300, 2000, 5000 }) {
+			 int expected_kcal, expected_protein, kcal, protein;
+			 sum_food_vector(expected_kcal, expected_protein, *dynamic_max_protein(copies, budget));
+			 auto meal = bounded_max_protein(servings_foods, budget);
+			 sum_food_vector(kcal, protein, *meal);
+			 TEST_EQUAL("optimal protein", expected_protein, protein);
+			 TEST_LE("within budget", kcal, budget);
+			 for (const auto& food : servings_foods)
+			   TEST_LE("servings limit", std::count(meal->begin(), meal->end(), food),
+				   long(food->max_servings()));
+		       }
+		     }
+
+		     //Zero-kcal foods with protein
+		     FoodVector free_foods;
+		     free_foods.push_back(std::shared_ptr<Food>(new Food("water", "1 cup", 240, 0, 0)));
+		     free_foods.push_back(std::shared_ptr<Food>(new Food("broth", "1 cup", 240, 0, 2,
+									 NutrientList(), 3)));
+		     free_foods.push_back((*filtered_foods)[0]);
+		     int free_kcal, free_protein;
+		     sum_food_vector(free_kcal, free_protein, *bounded_max_protein(free_foods, 0));
+		     TEST_EQUAL("every free serving", 6, free_protein);
+		     free_foods.push_back(std::shared_ptr<Food>(new Food("gelatin", "1 tbsp", 7, 0, 6,
+									 NutrientList(),
+									 UNLIMITED_SERVINGS)));
+		     TEST_FALSE("unbounded protein", bool(bounded_max_protein(free_foods, 2000)));
+		     TEST_TRUE("unbounded table result",
+			       bounded_max_protein(FoodTable(free_foods),
+						   std::vector<int>(free_foods.size(), UNLIMITED_SERVINGS),
+						   2000).empty());
+
+		     //Unlimited servings against a direct unbounded knapsack
+		     auto small_foods = filter_food_vector(*filtered_foods, 1, 2000, 100);
+		     FoodTable table(*small_foods);
+		     std::vector<int> unlimited(table.size(), UNLIMITED_SERVINGS);
+		     for (int budget : { 0, 300, 2000 }) {
+		       std::vector<int> best(budget + 1, 0);
+		       for (int w = 1; w <= budget; w++)
+			 for (int i = 0; i < int(table.size()); i++)
+			   if (table.kcal(i) <= w)
+			     best[w] = std::max(best[w], best[w - table.kcal(i)] + table.protein_g(i));
+		       std::vector<int> servings = bounded_max_protein(table, unlimited, budget);
+		       int kcal = 0, protein = 0;
+		       for (int i = 0; i < int(table.size()); i++) {
+			 kcal += servings[i] * table.kcal(i);
+			 protein += servings[i] * table.protein_g(i);
+		       }
+		       TEST_EQUAL("optimal protein", best[budget], protein);
+		       TEST_LE("within budget", kcal, budget);
+		     }
+		   });
+
+  rubric.criterion("IncrementalSolver", 4,
+		   [&]() {
+		     auto foods = filter_food_vector(*filtered_foods, 1, 2500, 600);
+		     FoodVector base(foods->begin(), foods->begin() + 500);
+		     IncrementalSolver solver(base, 2000, 16);
+		     TEST_EQUAL("size", 500u, solver.size());
+
+		     //Interleave additions and removals, checking against a cold solve
+		     unsigned state = 1;
+		     for (int step = 0; step < 60; step++) {
+		       state = state * 1103515245 + 12345;
+		       if (step % 3 != 2) {
+			 solver.add_food((*foods)[500 + step]);
+			 TEST_LE("add is one row", solver.rows_updated(), 1u);
+		       }
+		       else {
+			 solver.remove_food(size_t((state >> 8) % solver.size()));
+		       }
+		       int kcal, protein;
+		       sum_food_vector(kcal, protein, *dynamic_max_protein(solver.foods(), 2000));
+		       TEST_EQUAL("optimal protein", protein, solver.max_protein());
+		       int best_kcal = 0, best_protein = 0;
+		       for (int i : solver.best()) {
+			 best_kcal += solver.foods()[i]->kcal();
+			 best_protein += solver.foods()[i]->protein_g();
+		       }
+		       TEST_EQUAL("best matches", solver.max_protein(), best_protein);
+		       TEST_LE("within budget", best_kcal, 2000);
+		     }
+
+		     auto last = solver.foods().back();
+		     TEST_TRUE("remove by pointer", solver.remove_food(last));
+		     TEST_LE("cheap removal of a recent food", solver.rows_updated(), 16u);
+		     TEST_FALSE("already removed", solver.remove_food(last));
+		     while (solver.size() > 0)
+		       solver.remove_food(size_t(0));
+		     TEST_EQUAL("empty", 0, solver.max_protein());
+		     TEST_TRUE("nothing chosen", solver.best().empty());
+		   });
+
+  rubric.criterion("SolveService", 4,
+		   [&]() {
+		     auto table = load_shared_food_table("ABBREV.txt", 1, 2500, 8437);
+		     TEST_TRUE("loaded", bool(table));
+		     TEST_EQUAL("same foods", filtered_foods->size(), table->size());
+		     TEST_FALSE("missing file", bool(load_shared_food_table("missing.txt", 1, 2500, 10)));
+
+		     SolveService service(table, 2, 4);
+		     TEST_EQUAL("workers", 2u, service.workers());
+		     std::vector<int> budgets = { -1, 0, 300, 1000, 2000, 2500 };
+		     std::vector<std::future<IndexVector>> answers;
+		     for (int budget : budgets)
+		       answers.push_back(service.submit(budget));
+		     SolverOptions greedy;
+		     greedy.engine = SolverEngine::GREEDY;
+		     answers.push_back(service.submit(2000, greedy));
+		     for (size_t i = 0; i < answers.size(); i++) {
+		       const int budget = (i < budgets.size()) ? budgets[i] : 2000;
+		       int kcal, protein, expected_kcal, expected_protein;
+		       sum_food_vector(kcal, protein, *select_foods(*filtered_foods, answers[i].get()));
+		       sum_food_vector(expected_kcal, expected_protein,
+				       *max_protein(*filtered_foods, budget,
+						    (i < budgets.size()) ? SolverOptions() : greedy));
+		       TEST_EQUAL("same protein as max_protein", expected_protein, protein);
+		       TEST_LE("within budget", kcal, std::max(budget, 0));
+		     }
+
+		     //Hold the only worker in a callback, then fill the queue
+		     SolveService busy(table, 1, 1);
+		     std::promise<void> started, release;
+		     std::shared_future<void> released = release.get_future().share();
+		     std::atomic<int> protein(0);
+		     TEST_TRUE("callback queued",
+			       busy.try_submit(300, [&](const IndexVector& selection, std::exception_ptr error) {
+				   TEST_FALSE("no error", bool(error));
+				   for (int i : selection)
+				     protein += table->protein_g(i);
+				   started.set_value();
+				   released.wait();
+				 }));
+		     started.get_future().wait();
+		     std::future<IndexVector> queued, rejected;
+		     TEST_TRUE("room for one", busy.try_submit(1000, queued));
+		     TEST_FALSE("backpressure", busy.try_submit(2000, rejected));
+		     release.set_value();
+		     TEST_EQUAL("callback answer", 73, protein.load());
+		     int kcal, queued_protein;
+		     sum_food_vector(kcal, queued_protein, *select_foods(*filtered_foods, queued.get()));
+		     TEST_EQUAL("queued answer", 264, queued_protein);
+
+		     //A throwing callback must not stop the worker
+		     TEST_TRUE("throwing callback queued",
+			       busy.try_submit(300, [](const IndexVector&, std::exception_ptr) {
+				   throw std::runtime_error("callback failed");
+				 }));
+		     sum_food_vector(kcal, queued_protein, *select_foods(*filtered_foods,
+									 busy.submit(300).get()));
+		     TEST_EQUAL("worker survives", 73, queued_protein);
+		     busy.shutdown();
+		     TEST_FALSE("closed", busy.try_submit(300, rejected));
+
+		     //The workspace overload answers like the plain one
+		     SolverWorkspace workspace;
+		     FoodTable whole(*filtered_foods);
+		     for (int n : { 8, 40, 8437 }) {
+		       FoodTable part(n == 8437 ? whole :
+				      FoodTable(*filter_food_vector(*filtered_foods, 1, 2500, n)));
+		       for (int budget : { 300, 2000 })
+			 TEST_TRUE("same as max_protein",
+				   max_protein(part, budget, workspace, nullptr, 0) ==
+				   max_protein(part, budget).size() &&
+				   workspace.selection == max_protein(part, budget));
+		     }
+		   });
+
   return rubric.run();
 }